@@ -2,24 +2,100 @@
 
 #include "reg.hpp"
 #include "x64.hpp"
-#include <variant>
+#include <type_traits>
 
+// dispatches once on the operand width, func is instantiated for each of u8/u16/u32/u64
 template <typename Func>
-void calcOp(CPU *cpu, RegType type, const Reg *a, const Reg *b, Reg *result, Func func) {
-    auto va = a->get(type);
-    auto vb = b->get(type);
+inline void calcOp(CPU *cpu, RegType type, const Reg *a, const Reg *b, Reg *result, Func func) {
+    switch (type) {
+        case RegType::R8:  result->l = func(cpu, a->l, b->l); break;
+        case RegType::R8H: result->h = func(cpu, a->h, b->h); break;
+        case RegType::R16: result->x = func(cpu, a->x, b->x); break;
+        case RegType::R32: result->r = func(cpu, a->e, b->e); break;
+        case RegType::R64: result->r = func(cpu, a->r, b->r); break;
+        default: break;
+    }
+}
+
+// like calcOp, but hands func a std::bool_constant telling it whether anything reads the flags.
+// the liveness pass in CPU::decodeBlock() clears inst.flags_live when all of them are overwritten first
+template <typename Func>
+inline void calcOpFlags(CPU *cpu, RegType type, const Reg *a, const Reg *b, Reg *result, Func func) {
+    if (cpu->inst.flags_live) {
+        calcOp(cpu, type, a, b, result, [&](CPU *cpu, auto a, auto b) { return func(cpu, a, b, std::true_type{}); });
+    } else {
+        calcOp(cpu, type, a, b, result, [&](CPU *cpu, auto a, auto b) { return func(cpu, a, b, std::false_type{}); });
+    }
+}
+
+template <typename T, bool F = true>
+inline T add(CPU *cpu, T a, T b) {
+    T res = a + b;
+    if constexpr (F) cpu->setLazyFlags(FlagOp::ADD, sizeof(T) * 8, a, b, res);
+    return res;
+}
+
+template <typename T, bool F = true>
+inline T adc(CPU *cpu, T a, T b) {
+    u8 carry = cpu->getCF();
+    T res = a + b + carry;
+    if constexpr (F) cpu->setLazyFlags(FlagOp::ADD, sizeof(T) * 8, a, b, res, carry);
+    return res;
+}
+
+template <typename T, bool F = true>
+inline T sub(CPU *cpu, T a, T b) {
+    T res = a - b;
+    if constexpr (F) cpu->setLazyFlags(FlagOp::SUB, sizeof(T) * 8, a, b, res);
+    return res;
+}
+
+template <typename T, bool F = true>
+inline T andF(CPU *cpu, T a, T b) {
+    T res = a & b;
+    if constexpr (F) cpu->setLazyFlags(FlagOp::LOGIC, sizeof(T) * 8, a, b, res);
+    return res;
+}
+
+template <typename T, bool F = true>
+inline T xorF(CPU *cpu, T a, T b) {
+    T res = a ^ b;
+    if constexpr (F) cpu->setLazyFlags(FlagOp::LOGIC, sizeof(T) * 8, a, b, res);
+    return res;
+}
+
+template <typename T, bool F = true>
+inline T shl(CPU *cpu, T a, T b) {
+    constexpr int bits = sizeof(T) * 8;
 
-    std::visit([&](auto lhs, auto rhs) {
-        using T = decltype(lhs);
-        using U = decltype(rhs);
+    u8 count = b & ((bits == 64) ? 0x3F : 0x1F);
+    if (count == 0) return a;  // flags are left alone
+
+    T res = (count < bits) ? static_cast<T>(a << count) : 0;
+    if constexpr (F) cpu->setLazyFlags(FlagOp::SHL, bits, a, count, res);
+    return res;
+}
 
-        if constexpr(std::is_same_v<T, U>) {
-            result->set(type, static_cast<T>(func(cpu, lhs, rhs)));
-        }
-    }, va, vb);
+inline void add(CPU *cpu, RegType type, const Reg *a, const Reg *b, Reg *result) {
+    calcOpFlags(cpu, type, a, b, result, [](CPU *cpu, auto a, auto b, auto f) { return add<decltype(a), decltype(f)::value>(cpu, a, b); });
 }
 
-void add(CPU *cpu, RegType type, const Reg *a, const Reg *b, Reg *result);
-void sub(CPU *cpu, RegType type, const Reg *a, const Reg *b, Reg *result);
-void shl(CPU *cpu, RegType type, const Reg *a, const Reg *b, Reg *result);
-void xorF(CPU *cpu, RegType type, const Reg *a, const Reg *b, Reg *result);
\ No newline at end of file
+inline void adc(CPU *cpu, RegType type, const Reg *a, const Reg *b, Reg *result) {
+    calcOpFlags(cpu, type, a, b, result, [](CPU *cpu, auto a, auto b, auto f) { return adc<decltype(a), decltype(f)::value>(cpu, a, b); });
+}
+
+inline void sub(CPU *cpu, RegType type, const Reg *a, const Reg *b, Reg *result) {
+    calcOpFlags(cpu, type, a, b, result, [](CPU *cpu, auto a, auto b, auto f) { return sub<decltype(a), decltype(f)::value>(cpu, a, b); });
+}
+
+inline void shl(CPU *cpu, RegType type, const Reg *a, const Reg *b, Reg *result) {
+    calcOpFlags(cpu, type, a, b, result, [](CPU *cpu, auto a, auto b, auto f) { return shl<decltype(a), decltype(f)::value>(cpu, a, b); });
+}
+
+inline void andF(CPU *cpu, RegType type, const Reg *a, const Reg *b, Reg *result) {
+    calcOpFlags(cpu, type, a, b, result, [](CPU *cpu, auto a, auto b, auto f) { return andF<decltype(a), decltype(f)::value>(cpu, a, b); });
+}
+
+inline void xorF(CPU *cpu, RegType type, const Reg *a, const Reg *b, Reg *result) {
+    calcOpFlags(cpu, type, a, b, result, [](CPU *cpu, auto a, auto b, auto f) { return xorF<decltype(a), decltype(f)::value>(cpu, a, b); });
+}
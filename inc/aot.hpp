@@ -0,0 +1,64 @@
+#pragma once
+
+#include "types.hpp"
+#include "uop.hpp"
+#include "x64.hpp"
+#include <unordered_map>
+
+// everything precompiled blocks call back into, passed in so a plugin links against nothing
+struct AotHelpers {
+    u32  (*load)(CPU *cpu, u64 addr, u64 type, u64 *out);
+    u32  (*store)(CPU *cpu, u64 addr, u64 val, u64 type);
+    u32  (*call)(CPU *cpu, const DecodedInst *inst, u64 first);
+    u64  (*alu)(CPU *cpu, u64 op, u64 type, u64 flags, u64 a, u64 b);
+    u32  (*cond)(CPU *cpu, u64 cc);
+    void (*zeroFlags)(CPU *cpu);
+};
+
+template <CPUMode M>
+static const AotHelpers aot_helpers = {
+    nativeLoad<M>, nativeStore<M>, nativeCall<M>, nativeAlu, nativeCond, nativeZeroFlags,
+};
+
+// what a plugin was generated against, written into it as plain numbers. its code hardcodes the
+// uops, their temp numbering and the CPU and LazyFlags layouts, so a plugin from another build is refused
+struct AotStamp {
+    static constexpr u32 VERSION = 2;  // bump when translateBlock(), optimizeBlock() or AotWriter change
+
+    u32 version;
+    u32 cpu_size;    // sizeof(CPU) and sizeof(LazyFlags)
+    u32 flags_size;
+};
+
+// one block found by `accui64 --aot`. it only stands in for a translation of the same bytes, checked
+// by their hash and by the length, instruction and uop counts translateBlock() and optimizeBlock() gave
+struct AotBlock {
+    u64 addr;
+    u64 hash;  // RAM::hash() of the len bytes at addr
+    u32 len;
+    u32 insts;
+    u32 uops;
+    CPUMode mode;
+    AotFunc func;
+};
+
+#ifdef _WIN32
+#define ACCUI64_AOT_EXPORT __declspec(dllexport)
+#else
+#define ACCUI64_AOT_EXPORT __attribute__((visibility("default")))
+#endif
+
+#define ACCUI64_AOT_ENTRY "accui64_aot_blocks"
+#define ACCUI64_AOT_STAMP "accui64_aot_stamp"
+typedef const AotBlock *(*AotEntry)(u32 *count);
+typedef const AotStamp *(*AotStampEntry)();
+
+// the blocks of a plugin built from generated source, by address
+class AotPlugin {
+public:
+    bool load(const char *path);
+    AotFunc find(const IRBlock *block) const;
+
+private:
+    std::unordered_map<u64, const AotBlock *> blocks;
+};
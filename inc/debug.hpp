@@ -14,6 +14,7 @@ enum OpOrder {
 
 const char *getRegName(u8 idx, RegType type);
 const char *getRegPtrName(RegType type);
+const char *getCondName(u8 cc);
 void debugPrintMem(ModRM *modrm, u32 disp);
 void debugPrintReg(ModRM *modrm, u32 disp);
 void debugPrint(const char *name, ModRM *modrm, u32 disp, u64 val, OpOrder order);
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "types.hpp"
+#include "x64.hpp"
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// what a native routine sees of the guest. arguments come the way gcc passes them to the SeaBIOS
+// and coreboot helpers with regparm(3): EAX, EDX, ECX. pointers are offsets into DS, and stores go
+// through write() so verify mode can undo them
+class HleCall {
+public:
+    CPU *cpu;
+    bool journal;
+    std::vector<std::pair<u64, u8>> undo;  // linear address and old byte of every store while journal is set
+
+    HleCall(CPU *cpu, bool journal = false) : cpu(cpu), journal(journal) {}
+
+    u32 arg(int n) const;
+    void ret(u32 val);
+    u8 read(u32 ptr) const;
+    void write(u32 ptr, u8 val);
+};
+
+typedef void (*HleFunc)(HleCall &call);
+
+// a native stand-in for one guest routine, entered by a near CALL and left like its RET
+struct HleHook {
+    std::string name;
+    HleFunc func;
+    u64 addr = ~0ULL;     // linear address of the entry, found from sig when that is given
+    std::vector<u8> sig;  // prologue bytes looked for in the ROM
+    bool enabled = true;
+    u64 calls = 0;
+};
+
+class HleRegistry {
+public:
+    static constexpr u64 VERIFY_STEPS = 1 << 24;  // how long the original may run before a check gives up
+
+    bool verify = false;  // run the original after the hook too and compare
+
+    bool add(const std::string &spec);
+    void resolve();
+    void setEnabled(const std::string &name, bool on);
+    bool enter(CPU *cpu);
+    void report() const;
+
+    bool has(u64 addr) const {
+        return this->entries.count(addr) != 0;
+    }
+
+private:
+    std::vector<HleHook> hooks;
+    std::unordered_map<u64, u32> entries;  // enabled hooks by entry address
+
+    static HleFunc builtin(const std::string &name);
+    static void leave(CPU *cpu);
+    void check(CPU *cpu, HleHook &hook);
+};
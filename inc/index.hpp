@@ -0,0 +1,34 @@
+#pragma once
+
+#include "types.hpp"
+#include "x64.hpp"
+
+// layout of the decode index CPU::saveIndex() leaves behind for the next run with the same ROM:
+// the header, the IR blocks, then the instructions, all fixed size records so it can be mapped as is
+struct IndexHeader {
+    static constexpr u32 MAGIC   = 0x58444941;  // "AIDX"
+    static constexpr u32 VERSION = 5;
+
+    u32 magic;
+    u32 version;
+    u64 rom_hash;   // RAM::rom_hash of the image it was built from
+    u32 inst_size;  // sizeof(IndexInst) and sizeof(CPU), records are raw copies
+    u32 cpu_size;
+    u32 features;   // build flags that change what the decoder produces
+    u32 blocks;
+    u32 insts;
+};
+
+// an IRBlock by its instructions, insts[first, first + count)
+struct IndexBlock {
+    u64 addr;
+    CPUMode mode;
+    u32 first;
+    u32 count;
+};
+
+// a DecodedInst without host pointers, the ModRM and SIB operands as offsets into CPU and no ea
+struct IndexInst {
+    DecodedInst inst;
+    s32 ptrs[4];  // rm, reg, sib.idx, sib.base, -1 for none
+};
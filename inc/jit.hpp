@@ -0,0 +1,26 @@
+#pragma once
+
+#include "types.hpp"
+#include "uop.hpp"
+#include "x64.hpp"
+
+// translates hot IR blocks to host x86-64 code, bump allocated out of one executable buffer.
+// when the buffer fills up everything in it is dropped at once by bumping epoch
+class Jit {
+public:
+    static constexpr u32 HOT  = 16;  // interpreted runs before a block is compiled
+    static constexpr u64 SIZE = 16 << 20;
+
+    Jit();
+
+    template <CPUMode M> bool compile(CPU *cpu, IRBlock *block);
+
+    bool valid(const IRBlock *block) const {
+        return block->code && block->epoch == this->epoch;
+    }
+
+private:
+    u8 *buf = nullptr;
+    u64 used = 0;
+    u32 epoch = 1;
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "types.hpp"
+
+// what sits behind an MMIO region. offsets are from the start of the region, width is 1, 2, 4 or 8 bytes
+// and values are little endian in the low width bytes. accesses that run over a page end come a byte at a time
+class MmioDevice {
+public:
+    virtual ~MmioDevice() = default;
+
+    virtual u64 read(u64 offset, u32 width) = 0;
+    virtual void write(u64 offset, u64 val, u32 width) = 0;
+};
+
+// stands in for a device that is not modelled yet: prints every access, reads float high and writes
+// go nowhere. shows what the firmware probes where
+class MmioLog : public MmioDevice {
+public:
+    explicit MmioLog(u64 base) : base(base) {}
+
+    u64 read(u64 offset, u32 width) override;
+    void write(u64 offset, u64 val, u32 width) override;
+
+private:
+    u64 base;
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "types.hpp"
+
+// the few host OS services the emulator needs. they live in their own file, included last,
+// because windows.h defines macros such as CONST that clash with names elsewhere
+namespace OS {
+
+u8 *allocExec(u64 size);
+u8 *reserve(u64 size);
+bool commit(u8 *at, u64 size);
+bool mapFileAt(const char *path, u8 *at, u64 size);
+
+void *openLibrary(const char *path);
+void *findSymbol(void *lib, const char *name);
+
+const u8 *mapFile(const char *path, u64 *size);
+void unmapFile(const u8 *data, u64 size);
+
+};
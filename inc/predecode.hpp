@@ -0,0 +1,41 @@
+#pragma once
+
+#include "index.hpp"
+#include "types.hpp"
+#include "x64.hpp"
+#include <atomic>
+#include <memory>
+#include <thread>
+
+// decodes real mode ROM code on a thread of its own while the CPU starts executing, following jump
+// and call targets out from the reset vector. results go into a table the decoder reads without
+// locks: slots are written once, the address last, and never change after that
+class Predecoder {
+public:
+    static constexpr u32 SIZE   = 0x2000;
+    static constexpr u32 PROBES = 8;
+
+    Predecoder(u64 base, u16 ip);
+    ~Predecoder();
+
+    const IndexInst *find(u64 addr) const;
+    bool publish(const IndexInst &inst);
+
+    bool stopping() const {
+        return this->stop.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Slot {
+        std::atomic<u64> addr { ~0ULL };
+        IndexInst inst;  // packed against the decoding thread's CPU
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<bool> stop { false };
+    std::thread worker;
+
+    static u32 index(u64 addr) {
+        return (addr ^ (addr >> 13)) & (SIZE - 1);
+    }
+};
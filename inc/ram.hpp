@@ -1,13 +1,179 @@
 #pragma once
 
 #include "types.hpp"
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+class MmioDevice;
 
 namespace RAM {
 
-extern u8 *data;
+static constexpr u64 PHYS_BITS = 52;
+static constexpr u64 PHYS_MASK = (1ULL << PHYS_BITS) - 1;
+static constexpr u64 PAGE_BITS = 12;
+static constexpr u64 PAGE     = 1ULL << PAGE_BITS;
+static constexpr u64 TOP_4G   = 0x100000000ULL;
+
+// RAM and ROM come first, the fast paths below only have to test kind <= ROM
+enum class Kind : u8 {
+    RAM,
+    ROM,   // read only, the image sits right below 4 GiB
+    MMIO,  // every access goes to the region's device
+    HOLE,  // nothing there, reads float high and writes go nowhere
+};
+
+// a stretch of the physical address space, the machine is a list of these. later ones win where they overlap
+struct Region {
+    u64 base;
+    u64 size;
+    Kind kind;
+    MmioDevice *device = nullptr;  // MMIO only
+};
+
+struct Page {
+    u8 *host = nullptr;            // the page in host memory, RAM and ROM only
+    const Region *mmio = nullptr;  // the region an MMIO page belongs to
+    u32 gen = 0;                   // bumped on every write, lets decoded code notice it went stale
+    Kind kind = Kind::HOLE;
+};
+
+// the physical address space as a three level directory over 4 KiB pages: 14 + 13 + 13 bits of page number.
+// tables are only built for the parts that get looked at, from the regions, and never change after that
+struct PageTable {
+    static constexpr u32 BITS = 13;
+    Page pages[1 << BITS];
+};
+
+struct PageDir {
+    static constexpr u32 BITS = 13;
+    std::atomic<PageTable *> tables[1 << BITS];
+};
+
+static constexpr u32 ROOT_BITS = PHYS_BITS - PAGE_BITS - PageDir::BITS - PageTable::BITS;
+
+// the page looked up last on this thread, most accesses land on the same one as the one before
+struct LastHit {
+    u64 page = ~0ULL;
+    Page *entry = nullptr;
+};
+
+extern std::vector<Region> regions;
+extern thread_local LastHit last;
+extern u64 rom_size;
+extern u64 rom_hash;  // hash() of the image as loaded
+extern const u8 *rom_image;  // the image in host memory, rom_size bytes whatever is mapped over it
+
+std::vector<Region> defaultLayout(u64 rom_size);
+bool load(const char *filename, const std::vector<Region> &extra = {});
+void attach(u64 base, u64 size, MmioDevice *device);
+Page *lookup(u64 addr);
+u64 readSlow(const Page *p, u64 addr, u32 width);
+void writeSlow(const Page *p, u64 addr, u64 val, u32 width);
+
+inline Page *page(u64 addr) {
+    u64 n = (addr & PHYS_MASK) >> PAGE_BITS;
+    return (n == last.page) ? last.entry : lookup(addr);
+}
+
+inline u8 read(u64 addr) {
+    Page *p = page(addr);
+    if (p->kind <= Kind::ROM) return p->host[addr & (PAGE - 1)];
+    return readSlow(p, addr, 1);
+}
+
+inline void write(u64 addr, u8 val) {
+    Page *p = page(addr);
+    if (p->kind == Kind::RAM) {
+        p->host[addr & (PAGE - 1)] = val;
+        p->gen++;
+        return;
+    }
+    writeSlow(p, addr, val, 1);
+}
+
+// valid up to the end of the page, nullptr unless it is RAM or ROM
+inline u8 *hostPtr(u64 addr) {
+    Page *p = page(addr);
+    return (p->kind <= Kind::ROM) ? p->host + (addr & (PAGE - 1)) : nullptr;
+}
+
+// a T wide guest access. within one 4 KiB page of RAM or ROM that is a single unaligned host load or
+// store, anywhere else up to 8 bytes it is one device access. the rest, accesses that run into the next
+// page and vectors outside plain memory, go byte by byte so each page has its say
+template <typename T>
+inline T read(u64 addr) {
+    static constexpr u64 LAST = PAGE - sizeof(T);
+    T val;
+
+    if ((addr & (PAGE - 1)) <= LAST) {
+        Page *p = page(addr);
+        if (p->kind <= Kind::ROM) {
+            std::memcpy(&val, p->host + (addr & (PAGE - 1)), sizeof(T));
+            return val;
+        }
+        if constexpr (sizeof(T) <= 8) {
+            u64 raw = readSlow(p, addr, sizeof(T));
+            std::memcpy(&val, &raw, sizeof(T));
+            return val;
+        }
+    }
+
+    u8 buf[sizeof(T)];
+    for (u32 i = 0; i < sizeof(T); i++) buf[i] = read(addr + i);
+    std::memcpy(&val, buf, sizeof(T));
+    return val;
+}
+
+template <typename T>
+inline void write(u64 addr, T val) {
+    static constexpr u64 LAST = PAGE - sizeof(T);
+
+    if ((addr & (PAGE - 1)) <= LAST) {
+        Page *p = page(addr);
+        if (p->kind == Kind::RAM) {
+            std::memcpy(p->host + (addr & (PAGE - 1)), &val, sizeof(T));
+            p->gen++;
+            return;
+        }
+        if constexpr (sizeof(T) <= 8) {
+            u64 raw = 0;
+            std::memcpy(&raw, &val, sizeof(T));
+            writeSlow(p, addr, raw, sizeof(T));
+            return;
+        }
+    }
+
+    u8 buf[sizeof(T)];
+    std::memcpy(buf, &val, sizeof(T));
+    for (u32 i = 0; i < sizeof(T); i++) write(addr + i, buf[i]);
+}
+
+// only the image is known before anything runs, and the same from one run to the next
+inline bool inROM(u64 addr, u64 len) {
+    return addr >= TOP_4G - rom_size && addr + len <= TOP_4G;
+}
+
+// FNV-1a over guest bytes, what precompiled code is matched against
+inline u64 hash(u64 addr, u64 len) {
+    u64 h = 0xCBF29CE484222325ULL;
+    for (u64 i = 0; i < len; i++) {
+        h = (h ^ read(addr + i)) * 0x100000001B3ULL;
+    }
+    return h;
+}
+
+// the same over host bytes, for the image itself when a device may sit over part of it
+inline u64 hash(const u8 *bytes, u64 len) {
+    u64 h = 0xCBF29CE484222325ULL;
+    for (u64 i = 0; i < len; i++) {
+        h = (h ^ bytes[i]) * 0x100000001B3ULL;
+    }
+    return h;
+}
 
-void load(const char *filename);
-u8 read(u64 addr);
-void write(u64 addr, u8 val);
+inline u32 pageGen(u64 addr) {
+    return page(addr)->gen;
+}
 
-};
\ No newline at end of file
+};
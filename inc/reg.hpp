@@ -29,6 +29,10 @@ enum ExceptionType {
     VE, CP, _1, HV, VC, SX, _3,
 };
 
+// set of exception classes an instruction can raise, e.g. excMask<SS, GP, PF>
+template <ExceptionType... E>
+constexpr u32 excMask = ((1U << E) | ... | 0U);
+
 union Reg {
     u64 r;
     u16 x;
@@ -40,8 +44,14 @@ union Reg {
 
     Reg() { this->r = 0; }
 
-    Reg(u64 ptr) {
-        this->r = RAM::read(ptr);
+    // type wide from guest memory at ptr, zero extended
+    Reg(u64 ptr, RegType type) {
+        switch (type) {
+            case RegType::R16: this->r = RAM::read<u16>(ptr); break;
+            case RegType::R32: this->r = RAM::read<u32>(ptr); break;
+            case RegType::R64: this->r = RAM::read<u64>(ptr); break;
+            default:           this->r = RAM::read<u8>(ptr); break;
+        }
     }
 
     std::variant<u8, u16, u32, u64> get(RegType type) const {
@@ -105,6 +115,7 @@ struct Flags {
     u8 pf   : 1;
     u8 _1   : 1 = 0;
     u8 af   : 1;
+    u8 _r   : 1 = 0;
     u8 zf   : 1;
     u8 sf   : 1;
     u8 tf   : 1;
@@ -120,7 +131,7 @@ struct Flags {
     u8 vif  : 1;
     u8 vip  : 1;
     u8 id   : 1;
-    u8 _3   : 4 = 0;
+    u8 _3   : 2 = 0;
     u8 _4       = 0;
     u32 _5      = 0;
 };
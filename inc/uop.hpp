@@ -0,0 +1,162 @@
+#pragma once
+
+#include "types.hpp"
+#include "x64.hpp"
+#include <array>
+#include <vector>
+
+enum class UopKind : u8 {
+    NOP,        // left behind by the optimizer
+    CONST,      // t[dst] = imm
+    GETREG,     // t[dst] = regs[reg] as type
+    SETREG,     // regs[reg] as type = t[a]
+    EA,         // t[dst] = effective address of insts[inst]
+    LOAD,       // t[dst] = [t[a]]
+    STORE,      // [t[a]] = t[b]
+    ALU,        // t[dst] = alu(t[a], t[b]), records lazy flags if flags is set
+    ZEROFLAGS,  // flags after xor r, r
+    ADVANCE,    // IP += imm
+    BRANCH,     // IP += imm if cc holds, ends the block
+    JUMP,       // IP += imm, ends the block
+    CALL,       // insts[inst] through the handler tables, for everything not lowered
+};
+
+enum class AluOp : u8 {
+    ADD,
+    ADC,
+    SUB,
+    AND,
+    XOR,
+};
+
+typedef u64 (*UopAluFunc)(CPU *, u64, u64);
+typedef u32 (*JitFunc)(CPU *);
+
+struct AotHelpers;
+typedef u32 (*AotFunc)(CPU *, const DecodedInst *insts, const AotHelpers *h);
+
+// what a block compiled to native code, by the JIT or ahead of time, hands back to CPU::runIR()
+enum NativeExit : u32 {
+    NATIVE_DONE,   // block finished, trace it
+    NATIVE_HALT,   // first instruction halted, nothing to trace
+    NATIVE_FAULT,  // a helper caught a fault, it is in IRCache::fault
+    NATIVE_NEXT,   // helpers only, keep going
+};
+
+struct Uop {
+    UopKind kind = UopKind::NOP;
+    AluOp op     = AluOp::ADD;
+    RegType type = RegType::R64;  // access width, R8H for AH..BH
+    u8 reg = 0;
+    u8 dst = 0, a = 0, b = 0;     // temps
+    u8 cc  = 0;
+    bool flags = false;
+    u16 inst = 0;
+    u64 imm  = 0;
+    UopAluFunc alu = nullptr;
+};
+
+struct IRBlock;
+
+// a successor seen before, trusted only while the target still holds the translation it had then
+struct BlockLink {
+    IRBlock *block = nullptr;
+    u32 version = 0;
+};
+
+// how a block's last instruction leaves it, CALL and RET drive the ReturnStack
+enum class BlockExit : u8 {
+    PLAIN,
+    CALL,
+    RET,
+};
+
+// one straight-line run of guest code lowered to uops, cached by linear address
+struct IRBlock {
+    static constexpr int MAX_TEMPS = 128;
+
+    u64 addr = ~0ULL;
+    CPUMode mode;
+    u32 gen[2];
+    u32 len;  // guest bytes covered
+
+    std::vector<DecodedInst> insts;
+    std::vector<Uop> uops;
+
+    u32 runs  = 0;        // counts toward Jit::HOT
+    u32 epoch = 0;        // code is only valid while this matches the Jit's
+    JitFunc code = nullptr;
+    AotFunc aot  = nullptr;  // precompiled for these exact bytes, see AotPlugin
+
+    u32 version = 0;  // bumped by every translation into this slot
+    BlockExit exit = BlockExit::PLAIN;
+    BlockLink next[2];  // [0] the fall-through at addr + len, [1] the last other target
+
+    u64 end() const {
+        return this->addr + this->len;
+    }
+};
+
+// callers of the CALLs still in flight, a RET continues at the fall-through link of the one it pops.
+// overflow drops the oldest entries and a wrong guess is caught by the address check, so it is only a hint
+class ReturnStack {
+public:
+    static constexpr u32 DEPTH = 32;
+
+    void push(IRBlock *caller) {
+        this->entries[this->top++ & (DEPTH - 1)] = { caller, caller->version };
+    }
+
+    BlockLink pop() {
+        return this->entries[--this->top & (DEPTH - 1)];
+    }
+
+private:
+    std::array<BlockLink, DEPTH> entries;
+    u32 top = 0;
+};
+
+class IRCache {
+public:
+    static constexpr u32 SIZE = 0x400;
+
+    CPUFault fault;  // left here by the native helpers below
+
+    IRBlock *lookup(u64 addr, CPUMode mode);
+    IRBlock *linkOwner(IRBlock *from, u64 addr);
+    IRBlock *follow(IRBlock *owner, u64 addr, CPUMode mode);
+    void link(IRBlock *owner, IRBlock *to);
+
+    IRBlock *slot(u64 addr) {
+        return &this->entries[index(addr)];
+    }
+
+    template <typename F>
+    void forEach(F visit) {
+        for (IRBlock &block : this->entries) {
+            if (block.addr != ~0ULL && current(&block, block.addr, block.mode)) visit(block);
+        }
+    }
+
+private:
+    std::array<IRBlock, SIZE> entries;
+    ReturnStack rets;
+
+    static bool current(const IRBlock *block, u64 addr, CPUMode mode);
+
+    static u32 index(u64 addr) {
+        return (addr ^ (addr >> 10)) & (SIZE - 1);
+    }
+};
+
+UopAluFunc getUopAlu(AluOp op, RegType type, bool flags);
+void optimizeBlock(IRBlock *block);
+
+// what native blocks call for the uops they do not inline. none of them lets a CPUFault
+// unwind into native code, they return NATIVE_FAULT and leave it in IRCache::fault
+template <CPUMode M> u32 nativeLoad(CPU *cpu, u64 addr, u64 type, u64 *out);
+template <CPUMode M> u32 nativeStore(CPU *cpu, u64 addr, u64 val, u64 type);
+template <CPUMode M> u32 nativeCall(CPU *cpu, const DecodedInst *inst, u64 first);
+u64 nativeAlu(CPU *cpu, u64 op, u64 type, u64 flags, u64 a, u64 b);
+u32 nativeCond(CPU *cpu, u64 cc);
+void nativeZeroFlags(CPU *cpu);
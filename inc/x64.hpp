@@ -3,7 +3,6 @@
 #include "types.hpp"
 #include "reg.hpp"
 #include <array>
-#include <unordered_map>
 #include <vector>
 
 // reg = [idx * mul + base + disp]
@@ -44,12 +43,241 @@ struct ModRM {
     }
 };
 
+// legacy and REX prefixes in front of an opcode
+struct Prefixes {
+    bool op   = false;  // 66
+    bool ad   = false;  // 67
+    bool lock = false;  // F0
+    u8 rep    = 0;      // F2 / F3
+    u8 seg    = 0xFF;   // index into st_regs for 26/2E/36/3E/64/65
+
+    bool has_rex = false;
+    u8 rex       = 0;
+
+    // REX bits moved up to bit 3 of a register index
+    u8 rexR() const { return (rex & REXBit::R) << 1; }
+    u8 rexX() const { return (rex & REXBit::X) << 2; }
+    u8 rexB() const { return (rex & REXBit::B) << 3; }
+};
+
+enum CPUMode : u8 {
+    MODE_REAL,
+    MODE_PROT,
+    MODE_LONG,
+};
+
+enum ImmKind : u8 {
+    IMM_NONE,
+    IMM_B,      // 8 bits
+    IMM_W,      // 16 bits
+    IMM_Z,      // 16 or 32 bits by operand size
+    IMM_V,      // 16, 32 or 64 bits by operand size
+    IMM_ENTER,  // 16 bits then 8 bits
+    IMM_PTR,    // far pointer, Iz offset then 16 bit selector
+    IMM_MOFFS,  // offset sized by address size
+    IMM_GRP3,   // Ib/Iz only for TEST (/0 and /1)
+};
+
+enum OpSize : u8 {
+    OS_NONE,
+    OS_B,
+    OS_W,
+    OS_V,
+};
+
+enum ModeMask : u8 {
+    M_REAL   = 1 << MODE_REAL,
+    M_PROT   = 1 << MODE_PROT,
+    M_LONG   = 1 << MODE_LONG,
+    M_LEGACY = M_REAL | M_PROT,
+    M_ALL    = M_REAL | M_PROT | M_LONG,
+};
+
+// status flags as tracked by the liveness pass
+enum FlagBit : u8 {
+    FL_CF = 1 << 0,
+    FL_PF = 1 << 1,
+    FL_AF = 1 << 2,
+    FL_ZF = 1 << 3,
+    FL_SF = 1 << 4,
+    FL_OF = 1 << 5,
+    FL_STATUS = 0x3F,
+};
+
+// what the decoder needs to know about an opcode to find its length, and what
+// CPU::decodeBlock() needs to know about its flags and control flow
+struct OpAttr {
+    bool modrm;
+    ImmKind imm;
+    OpSize size;
+    u8 modes;
+
+    u8 fl_read  = FL_STATUS;  // unknown opcodes may read anything
+    u8 fl_write = 0;          // flags always overwritten, a shift by 0 writes none so shifts have 0 here
+    bool ends_block = false;
+};
+
+// pairs and idioms the decoder folds into one dispatch, see CPU::fuse()
+enum FuseKind : u8 {
+    FUSE_NONE,
+    FUSE_ZERO,     // xor/sub r, r
+    FUSE_CMP_JCC,  // cmp/test on registers or an immediate, then jcc
+    FUSE_MOV_IMM,  // mov r, imm twice in a row
+    FUSE_COUNT,
+};
+
+class CPU;
+class IRCache;
+class Jit;
+class AotPlugin;
+class Predecoder;
+class HleRegistry;
+struct IndexInst;
+struct IRBlock;
+struct DecodedInst;
+
+typedef u64 (*EAFunc)(CPU *, const DecodedInst *);
+
+// one instruction as produced by CPU::decode(), cached by linear address
+struct DecodedInst {
+    u64 addr = ~0ULL;
+    u32 gen[2];
+    CPUMode mode;
+    bool valid;
+
+    u8 bytes[15];
+    u8 len = 0;
+    Prefixes pfx;
+    u16 opcode = 0;  // 0x0Fxx for the two-byte map
+
+    bool has_modrm = false;
+    ModRM modrm = ModRM(0, 0, 0);
+    u32 disp = 0;  // sign extended to 32 bits
+    u64 imm = 0;
+
+    // memory operand address, chosen by the decoder from the ModRM/SIB shape
+    EAFunc ea = nullptr;
+    u8 ea_base  = 0;
+    u8 ea_idx   = 0;
+    u8 ea_scale = 0;  // shift count
+
+    // second instruction of a fused pair, len covers both
+    FuseKind fuse = FUSE_NONE;
+    u8 fuse_op  = 0;  // jcc condition or mov destination
+    u64 fuse_imm = 0; // jcc displacement (sign extended) or mov immediate
+
+    u8 flags_live = FL_STATUS;  // flags read before being overwritten after this instruction
+};
+
+enum class FlagOp : u8 {
+    NONE,
+    ADD,
+    SUB,
+    LOGIC,
+    SHL,
+};
+
+// operands of the last flag-setting ALU op, the status flags are derived from it on demand
+struct LazyFlags {
+    FlagOp op = FlagOp::NONE;
+    u8 bits;
+    u8 carry;  // carry/borrow in for ADC and SBB
+    u64 a, b, res;
+
+    bool cf() const;
+    bool pf() const;
+    bool af() const;
+    bool zf() const;
+    bool sf() const;
+    bool of() const;
+
+    bool cond(u8 cc) const;
+};
+
+class DecodeCache {
+public:
+    static constexpr u32 SIZE = 0x1000;
+
+    DecodedInst *lookup(u64 addr, CPUMode mode);
+    void insert(const DecodedInst &inst);
+
+    template <typename F>
+    void forEach(F visit) {
+        for (DecodedInst &entry : this->entries) {
+            if (entry.addr != ~0ULL && this->lookup(entry.addr, entry.mode) == &entry) visit(entry);
+        }
+    }
+
+private:
+    std::array<DecodedInst, SIZE> entries;
+
+    static u32 index(u64 addr) {
+        return (addr ^ (addr >> 12)) & (SIZE - 1);
+    }
+};
+
+// thrown by CPU::raiseFault, unwinds the handler back to the run loop
+struct CPUFault {
+    ExceptionType type;
+    u64 addr;
+};
+
+// host view of the guest code page currently being decoded
+struct FetchWindow {
+    static constexpr u64 PAGE = 0x1000;
+
+    const u8 *host = nullptr;
+    u64 base = 0;
+
+    bool contains(u64 addr, u32 n) const {
+        return this->host && addr - this->base <= PAGE - n;
+    }
+};
+
+// FAST runs silently, TRACE prints every instruction and the registers after it
+enum class Tier : u8 {
+    FAST,
+    TRACE,
+};
+
+// switches to another tier once, when the guest gets somewhere. see CPU::checkTriggers()
+struct TierTrigger {
+    enum Kind : u8 {
+        ADDR,   // CS:IP reaches linear address value
+        COUNT,  // value instructions have retired
+        POST,   // the guest writes value to the POST code port
+    };
+
+    Kind kind;
+    u64 value;
+    Tier to;
+};
+
 class CPU {
 public:
+    static constexpr int MAX_BLOCK = 16;
+    static constexpr u16 POST_PORT = 0x80;
+
     bool running;
 
     u8 curr_inst;
-    std::unordered_map<const char *, u8> extra_info;
+    CPUMode mode;
+
+    DecodedInst inst;
+    ModRM modrm_slot = ModRM(0, 0, 0);
+    DecodeCache icache;
+    FetchWindow fetch_win;
+    u64 fuse_hits[FUSE_COUNT] = {};
+    IRCache *ir_cache = nullptr;
+    Jit *jit = nullptr;
+    AotPlugin *aot = nullptr;
+    Predecoder *predecoder = nullptr;
+    HleRegistry *hle = nullptr;
+
+    Tier tier = Tier::TRACE;
+    std::vector<TierTrigger> triggers;
+    u64 retired = 0;  // per instruction in the interpreters, per block under the IR
+    u8 post_code = 0;
     
     Reg regs[17];
     u64 mm_regs[8];
@@ -59,7 +287,9 @@ public:
     u32 db_regs[8];
     u32 tr_regs[8];
 
+    // CF, PF, AF, ZF, SF and OF are stale while lazy.op != NONE, go through the accessors below
     Flags RFLAGS;
+    LazyFlags lazy;
 
     GDTR GDTR;
     u16 LDTR;
@@ -75,12 +305,55 @@ public:
     void setupRegs();
 
     void run();
+    void buildAOT(const char *path);
+    bool loadIndex();
+    void saveIndex();
+    void predecode(Predecoder *into, u64 base, u16 ip);
     bool runStep();
+    void fetchInst();
+    template <CPUMode M> void decode();
+    bool execute();
+    void traceStep(u64 insts = 1);
+    void setTier(Tier tier);
+    void checkTriggers(bool post = false);
+    void out(u16 port, u8 val);
+    void handleFault(const CPUFault &fault);
+    void updateMode();
+#ifdef ACCUI64_THREADED
+    template <CPUMode M> void runThreaded();
+#endif
 
     bool HALT();
+    bool invalidOpcode();
+
+    void setLazyFlags(FlagOp op, u8 bits, u64 a, u64 b, u64 res, u8 carry = 0) {
+        this->lazy = { op, bits, carry, a, b, res };
+    }
+
+    // the flags xor r, r leaves, a zero LOGIC result: ZF and PF set, the rest clear
+    void zeroFlags() {
+        this->setLazyFlags(FlagOp::LOGIC, 32, 0, 0, 0);
+    }
 
-    ModRM *getModRM(RegType type);
+    bool getCF() { return (this->lazy.op != FlagOp::NONE) ? this->lazy.cf() : RFLAGS.cf; }
+    bool getPF() { return (this->lazy.op != FlagOp::NONE) ? this->lazy.pf() : RFLAGS.pf; }
+    bool getAF() { return (this->lazy.op != FlagOp::NONE) ? this->lazy.af() : RFLAGS.af; }
+    bool getZF() { return (this->lazy.op != FlagOp::NONE) ? this->lazy.zf() : RFLAGS.zf; }
+    bool getSF() { return (this->lazy.op != FlagOp::NONE) ? this->lazy.sf() : RFLAGS.sf; }
+    bool getOF() { return (this->lazy.op != FlagOp::NONE) ? this->lazy.of() : RFLAGS.of; }
+
+    Flags &getFlags();
+    u64 getFlagsVal();
+    void setFlagsVal(u64 val, u64 mask);
+    bool testCond(u8 cc);
+
+    void push(u64 val, RegType type);
+    u64 pop(RegType type);
+    u64 readMem(u64 addr, RegType type);
+
+    ModRM *getModRM();
     u64 getModRMPtr(ModRM *modrm, u32 &disp);
+    Reg *getRMReg(ModRM *modrm, u64 ptr, Reg &mem);
 
     u8 read();
     void write(u64 addr, u8 val);
@@ -90,20 +363,58 @@ public:
     u16 getVal16();
     u32 getVal32();
 
-    bool checkExceptions(u64 ptr, const std::vector<ExceptionType> &exceptions);
+    template <CPUMode M, u32 Mask> void checkExceptions(u64 ptr);
+    [[noreturn]] void raiseFault(ExceptionType type, u64 ptr);
 
 private:
-    ModRM *getModRM16(RegType type);
-    ModRM *getModRM32(RegType type);
+    template <CPUMode M> u8 decodePrefixes();
+    template <typename T> T fetch();
+    u16 fetch16();
+    u32 fetch32();
+
+    void getModRM16(ModRM *modrm, RegType type);
+    void getModRM32(ModRM *modrm, RegType type);
     
     void determineModRMMod3(ModRM *modrm, RegType type);
     void determineModRMMod0to2(ModRM *modrm, RegType type);
     void determineModRMSib(ModRM *modrm, RegType type, u8 sib);
+    template <CPUMode M> void selectEA();
 
     void debugPrintRegs();
+    void debugPrintFusion();
+
+    void fuse();
+    bool fuseJcc();
+    void decodeBlock(u64 addr);
+    bool packInst(const DecodedInst &inst, IndexInst &out) const;
+    DecodedInst unpackInst(const IndexInst &packed);
+    int decodeRun(u64 addr, DecodedInst *block);
+    bool takePredecoded(u64 addr);
+    template <CPUMode M> static int runExits(const DecodedInst &last, s64 exits[2]);
+    template <CPUMode M> bool execFused();
+
+    template <CPUMode M> void runIR();
+    template <CPUMode M> void translateBlock(u64 addr, IRBlock *block, const DecodedInst *known = nullptr, int known_count = 0);
+    template <CPUMode M> bool runIRBlock(const IRBlock *block);
 
-    static const std::array<bool (CPU::*)(), 0x100> opcode_table;
-    static const std::array<bool (CPU::*)(), 0x100> opcode_table_0F;
+    template <CPUMode M> bool jccRel8();
+    template <CPUMode M> bool jccRel();
+    template <CPUMode M> bool movRegImm();
+    template <CPUMode M> bool setcc();
+
+    // one handler table per mode, the active ones are only swapped by updateMode()
+    static const std::array<bool (CPU::*)(), 0x100> opcode_table[3];
+    static const std::array<bool (CPU::*)(), 0x100> opcode_table_0F[3];
+    const std::array<bool (CPU::*)(), 0x100> *active_table;
+    const std::array<bool (CPU::*)(), 0x100> *active_table_0F;
+    void (CPU::*active_decode)();
+    bool (CPU::*active_fused)();
+    static const std::array<OpAttr, 0x100> opcode_attr;
+    static const std::array<OpAttr, 0x100> opcode_attr_0F;
+
+    static const OpAttr *attrOf(const DecodedInst &inst) {
+        return (inst.opcode > 0xFF) ? &opcode_attr_0F[inst.opcode & 0xFF] : &opcode_attr[inst.opcode];
+    }
     void initBind();
 
 public:
@@ -114,15 +425,44 @@ public:
     bool isLongMode() {
         return CR0->pe && CR4->pae && IA32_EFER.lma;
     }
+
+    CPUMode getMode() {
+        if (this->isLongMode()) return MODE_LONG;
+        return (CR0->pe) ? MODE_PROT : MODE_REAL;
+    }
+
+    template <CPUMode M>
+    RegType getOpSize() {
+        return opSizeOf<M>(this->inst.pfx);
+    }
+
+    // near CALL and RET, which default to 64 bits in long mode
+    template <CPUMode M>
+    RegType getNearSize() {
+        RegType type = this->getOpSize<M>();
+        return (M == MODE_LONG && type == RegType::R32) ? RegType::R64 : type;
+    }
+
+    template <CPUMode M>
+    static RegType opSizeOf(const Prefixes &pfx) {
+        if constexpr (M == MODE_LONG) {
+            if (pfx.rex & REXBit::W) return RegType::R64;
+            return (pfx.op) ? RegType::R16 : RegType::R32;
+        } else if constexpr (M == MODE_PROT) {
+            return (pfx.op) ? RegType::R16 : RegType::R32;
+        } else {
+            return (pfx.op) ? RegType::R32 : RegType::R16;
+        }
+    }
     
     Reg *AX  = &regs[ 0];
     Reg *CX  = &regs[ 1];
     Reg *DX  = &regs[ 2];
     Reg *BX  = &regs[ 3];
-    Reg *SI  = &regs[ 4];
-    Reg *DI  = &regs[ 5];
-    Reg *SP  = &regs[ 6];
-    Reg *BP  = &regs[ 7];
+    Reg *SP  = &regs[ 4];
+    Reg *BP  = &regs[ 5];
+    Reg *SI  = &regs[ 6];
+    Reg *DI  = &regs[ 7];
     Reg *R8  = &regs[ 8];
     Reg *R9  = &regs[ 9];
     Reg *R10 = &regs[10];
@@ -153,71 +493,45 @@ public:
     u32 *DR6 = &db_regs[6];
     DR7 *DR7 = (struct DR7 *)&db_regs[7];
     
-    bool OP_00(); bool OP_01(); bool OP_02(); bool OP_03(); bool OP_04(); bool OP_05(); bool OP_06(); bool OP_07();
-    bool OP_08(); bool OP_09(); bool OP_0A(); bool OP_0B(); bool OP_0C(); bool OP_0D(); bool OP_0E(); bool OP_0F();
-    bool OP_10(); bool OP_11(); bool OP_12(); bool OP_13(); bool OP_14(); bool OP_15(); bool OP_16(); bool OP_17();
-    bool OP_18(); bool OP_19(); bool OP_1A(); bool OP_1B(); bool OP_1C(); bool OP_1D(); bool OP_1E(); bool OP_1F();
-    bool OP_20(); bool OP_21(); bool OP_22(); bool OP_23(); bool OP_24(); bool OP_25(); bool OP_26(); bool OP_27();
-    bool OP_28(); bool OP_29(); bool OP_2A(); bool OP_2B(); bool OP_2C(); bool OP_2D(); bool OP_2E(); bool OP_2F();
-    bool OP_30(); bool OP_31(); bool OP_32(); bool OP_33(); bool OP_34(); bool OP_35(); bool OP_36(); bool OP_37();
-    bool OP_38(); bool OP_39(); bool OP_3A(); bool OP_3B(); bool OP_3C(); bool OP_3D(); bool OP_3E(); bool OP_3F();
-    bool OP_40(); bool OP_41(); bool OP_42(); bool OP_43(); bool OP_44(); bool OP_45(); bool OP_46(); bool OP_47();
-    bool OP_48(); bool OP_49(); bool OP_4A(); bool OP_4B(); bool OP_4C(); bool OP_4D(); bool OP_4E(); bool OP_4F();
-    bool OP_50(); bool OP_51(); bool OP_52(); bool OP_53(); bool OP_54(); bool OP_55(); bool OP_56(); bool OP_57();
-    bool OP_58(); bool OP_59(); bool OP_5A(); bool OP_5B(); bool OP_5C(); bool OP_5D(); bool OP_5E(); bool OP_5F();
-    bool OP_60(); bool OP_61(); bool OP_62(); bool OP_63(); bool OP_64(); bool OP_65(); bool OP_66(); bool OP_67();
-    bool OP_68(); bool OP_69(); bool OP_6A(); bool OP_6B(); bool OP_6C(); bool OP_6D(); bool OP_6E(); bool OP_6F();
-    bool OP_70(); bool OP_71(); bool OP_72(); bool OP_73(); bool OP_74(); bool OP_75(); bool OP_76(); bool OP_77();
-    bool OP_78(); bool OP_79(); bool OP_7A(); bool OP_7B(); bool OP_7C(); bool OP_7D(); bool OP_7E(); bool OP_7F();
-    bool OP_80(); bool OP_81(); bool OP_82(); bool OP_83(); bool OP_84(); bool OP_85(); bool OP_86(); bool OP_87();
-    bool OP_88(); bool OP_89(); bool OP_8A(); bool OP_8B(); bool OP_8C(); bool OP_8D(); bool OP_8E(); bool OP_8F();
-    bool OP_90(); bool OP_91(); bool OP_92(); bool OP_93(); bool OP_94(); bool OP_95(); bool OP_96(); bool OP_97();
-    bool OP_98(); bool OP_99(); bool OP_9A(); bool OP_9B(); bool OP_9C(); bool OP_9D(); bool OP_9E(); bool OP_9F();
-    bool OP_A0(); bool OP_A1(); bool OP_A2(); bool OP_A3(); bool OP_A4(); bool OP_A5(); bool OP_A6(); bool OP_A7();
-    bool OP_A8(); bool OP_A9(); bool OP_AA(); bool OP_AB(); bool OP_AC(); bool OP_AD(); bool OP_AE(); bool OP_AF();
-    bool OP_B0(); bool OP_B1(); bool OP_B2(); bool OP_B3(); bool OP_B4(); bool OP_B5(); bool OP_B6(); bool OP_B7();
-    bool OP_B8(); bool OP_B9(); bool OP_BA(); bool OP_BB(); bool OP_BC(); bool OP_BD(); bool OP_BE(); bool OP_BF();
-    bool OP_C0(); bool OP_C1(); bool OP_C2(); bool OP_C3(); bool OP_C4(); bool OP_C5(); bool OP_C6(); bool OP_C7();
-    bool OP_C8(); bool OP_C9(); bool OP_CA(); bool OP_CB(); bool OP_CC(); bool OP_CD(); bool OP_CE(); bool OP_CF();
-    bool OP_D0(); bool OP_D1(); bool OP_D2(); bool OP_D3(); bool OP_D4(); bool OP_D5(); bool OP_D6(); bool OP_D7();
-    bool OP_D8(); bool OP_D9(); bool OP_DA(); bool OP_DB(); bool OP_DC(); bool OP_DD(); bool OP_DE(); bool OP_DF();
-    bool OP_E0(); bool OP_E1(); bool OP_E2(); bool OP_E3(); bool OP_E4(); bool OP_E5(); bool OP_E6(); bool OP_E7();
-    bool OP_E8(); bool OP_E9(); bool OP_EA(); bool OP_EB(); bool OP_EC(); bool OP_ED(); bool OP_EE(); bool OP_EF();
-    bool OP_F0(); bool OP_F1(); bool OP_F2(); bool OP_F3(); bool OP_F4(); bool OP_F5(); bool OP_F6(); bool OP_F7();
-    bool OP_F8(); bool OP_F9(); bool OP_FA(); bool OP_FB(); bool OP_FC(); bool OP_FD(); bool OP_FE(); bool OP_FF();
-    
-    bool OP_0F_00(); bool OP_0F_01(); bool OP_0F_02(); bool OP_0F_03(); bool OP_0F_04(); bool OP_0F_05(); bool OP_0F_06(); bool OP_0F_07();
-    bool OP_0F_08(); bool OP_0F_09(); bool OP_0F_0A(); bool OP_0F_0B(); bool OP_0F_0C(); bool OP_0F_0D(); bool OP_0F_0E(); bool OP_0F_0F();
-    bool OP_0F_10(); bool OP_0F_11(); bool OP_0F_12(); bool OP_0F_13(); bool OP_0F_14(); bool OP_0F_15(); bool OP_0F_16(); bool OP_0F_17();
-    bool OP_0F_18(); bool OP_0F_19(); bool OP_0F_1A(); bool OP_0F_1B(); bool OP_0F_1C(); bool OP_0F_1D(); bool OP_0F_1E(); bool OP_0F_1F();
-    bool OP_0F_20(); bool OP_0F_21(); bool OP_0F_22(); bool OP_0F_23(); bool OP_0F_24(); bool OP_0F_25(); bool OP_0F_26(); bool OP_0F_27();
-    bool OP_0F_28(); bool OP_0F_29(); bool OP_0F_2A(); bool OP_0F_2B(); bool OP_0F_2C(); bool OP_0F_2D(); bool OP_0F_2E(); bool OP_0F_2F();
-    bool OP_0F_30(); bool OP_0F_31(); bool OP_0F_32(); bool OP_0F_33(); bool OP_0F_34(); bool OP_0F_35(); bool OP_0F_36(); bool OP_0F_37();
-    bool OP_0F_38(); bool OP_0F_39(); bool OP_0F_3A(); bool OP_0F_3B(); bool OP_0F_3C(); bool OP_0F_3D(); bool OP_0F_3E(); bool OP_0F_3F();
-    bool OP_0F_40(); bool OP_0F_41(); bool OP_0F_42(); bool OP_0F_43(); bool OP_0F_44(); bool OP_0F_45(); bool OP_0F_46(); bool OP_0F_47();
-    bool OP_0F_48(); bool OP_0F_49(); bool OP_0F_4A(); bool OP_0F_4B(); bool OP_0F_4C(); bool OP_0F_4D(); bool OP_0F_4E(); bool OP_0F_4F();
-    bool OP_0F_50(); bool OP_0F_51(); bool OP_0F_52(); bool OP_0F_53(); bool OP_0F_54(); bool OP_0F_55(); bool OP_0F_56(); bool OP_0F_57();
-    bool OP_0F_58(); bool OP_0F_59(); bool OP_0F_5A(); bool OP_0F_5B(); bool OP_0F_5C(); bool OP_0F_5D(); bool OP_0F_5E(); bool OP_0F_5F();
-    bool OP_0F_60(); bool OP_0F_61(); bool OP_0F_62(); bool OP_0F_63(); bool OP_0F_64(); bool OP_0F_65(); bool OP_0F_66(); bool OP_0F_67();
-    bool OP_0F_68(); bool OP_0F_69(); bool OP_0F_6A(); bool OP_0F_6B(); bool OP_0F_6C(); bool OP_0F_6D(); bool OP_0F_6E(); bool OP_0F_6F();
-    bool OP_0F_70(); bool OP_0F_71(); bool OP_0F_72(); bool OP_0F_73(); bool OP_0F_74(); bool OP_0F_75(); bool OP_0F_76(); bool OP_0F_77();
-    bool OP_0F_78(); bool OP_0F_79(); bool OP_0F_7A(); bool OP_0F_7B(); bool OP_0F_7C(); bool OP_0F_7D(); bool OP_0F_7E(); bool OP_0F_7F();
-    bool OP_0F_80(); bool OP_0F_81(); bool OP_0F_82(); bool OP_0F_83(); bool OP_0F_84(); bool OP_0F_85(); bool OP_0F_86(); bool OP_0F_87();
-    bool OP_0F_88(); bool OP_0F_89(); bool OP_0F_8A(); bool OP_0F_8B(); bool OP_0F_8C(); bool OP_0F_8D(); bool OP_0F_8E(); bool OP_0F_8F();
-    bool OP_0F_90(); bool OP_0F_91(); bool OP_0F_92(); bool OP_0F_93(); bool OP_0F_94(); bool OP_0F_95(); bool OP_0F_96(); bool OP_0F_97();
-    bool OP_0F_98(); bool OP_0F_99(); bool OP_0F_9A(); bool OP_0F_9B(); bool OP_0F_9C(); bool OP_0F_9D(); bool OP_0F_9E(); bool OP_0F_9F();
-    bool OP_0F_A0(); bool OP_0F_A1(); bool OP_0F_A2(); bool OP_0F_A3(); bool OP_0F_A4(); bool OP_0F_A5(); bool OP_0F_A6(); bool OP_0F_A7();
-    bool OP_0F_A8(); bool OP_0F_A9(); bool OP_0F_AA(); bool OP_0F_AB(); bool OP_0F_AC(); bool OP_0F_AD(); bool OP_0F_AE(); bool OP_0F_AF();
-    bool OP_0F_B0(); bool OP_0F_B1(); bool OP_0F_B2(); bool OP_0F_B3(); bool OP_0F_B4(); bool OP_0F_B5(); bool OP_0F_B6(); bool OP_0F_B7();
-    bool OP_0F_B8(); bool OP_0F_B9(); bool OP_0F_BA(); bool OP_0F_BB(); bool OP_0F_BC(); bool OP_0F_BD(); bool OP_0F_BE(); bool OP_0F_BF();
-    bool OP_0F_C0(); bool OP_0F_C1(); bool OP_0F_C2(); bool OP_0F_C3(); bool OP_0F_C4(); bool OP_0F_C5(); bool OP_0F_C6(); bool OP_0F_C7();
-    bool OP_0F_C8(); bool OP_0F_C9(); bool OP_0F_CA(); bool OP_0F_CB(); bool OP_0F_CC(); bool OP_0F_CD(); bool OP_0F_CE(); bool OP_0F_CF();
-    bool OP_0F_D0(); bool OP_0F_D1(); bool OP_0F_D2(); bool OP_0F_D3(); bool OP_0F_D4(); bool OP_0F_D5(); bool OP_0F_D6(); bool OP_0F_D7();
-    bool OP_0F_D8(); bool OP_0F_D9(); bool OP_0F_DA(); bool OP_0F_DB(); bool OP_0F_DC(); bool OP_0F_DD(); bool OP_0F_DE(); bool OP_0F_DF();
-    bool OP_0F_E0(); bool OP_0F_E1(); bool OP_0F_E2(); bool OP_0F_E3(); bool OP_0F_E4(); bool OP_0F_E5(); bool OP_0F_E6(); bool OP_0F_E7();
-    bool OP_0F_E8(); bool OP_0F_E9(); bool OP_0F_EA(); bool OP_0F_EB(); bool OP_0F_EC(); bool OP_0F_ED(); bool OP_0F_EE(); bool OP_0F_EF();
-    bool OP_0F_F0(); bool OP_0F_F1(); bool OP_0F_F2(); bool OP_0F_F3(); bool OP_0F_F4(); bool OP_0F_F5(); bool OP_0F_F6(); bool OP_0F_F7();
-    bool OP_0F_F8(); bool OP_0F_F9(); bool OP_0F_FA(); bool OP_0F_FB(); bool OP_0F_FC(); bool OP_0F_FD(); bool OP_0F_FE(); bool OP_0F_FF();
+#define OP(n) template <CPUMode M> bool OP_##n();
+#define OP0F(n) template <CPUMode M> bool OP_0F_##n();
+
+    OP(00)OP(01)OP(02)OP(03)OP(04)OP(05)OP(06)OP(07)OP(08)OP(09)OP(0A)OP(0B)OP(0C)OP(0D)OP(0E)OP(0F)
+    OP(10)OP(11)OP(12)OP(13)OP(14)OP(15)OP(16)OP(17)OP(18)OP(19)OP(1A)OP(1B)OP(1C)OP(1D)OP(1E)OP(1F)
+    OP(20)OP(21)OP(22)OP(23)OP(24)OP(25)OP(26)OP(27)OP(28)OP(29)OP(2A)OP(2B)OP(2C)OP(2D)OP(2E)OP(2F)
+    OP(30)OP(31)OP(32)OP(33)OP(34)OP(35)OP(36)OP(37)OP(38)OP(39)OP(3A)OP(3B)OP(3C)OP(3D)OP(3E)OP(3F)
+    OP(40)OP(41)OP(42)OP(43)OP(44)OP(45)OP(46)OP(47)OP(48)OP(49)OP(4A)OP(4B)OP(4C)OP(4D)OP(4E)OP(4F)
+    OP(50)OP(51)OP(52)OP(53)OP(54)OP(55)OP(56)OP(57)OP(58)OP(59)OP(5A)OP(5B)OP(5C)OP(5D)OP(5E)OP(5F)
+    OP(60)OP(61)OP(62)OP(63)OP(64)OP(65)OP(66)OP(67)OP(68)OP(69)OP(6A)OP(6B)OP(6C)OP(6D)OP(6E)OP(6F)
+    OP(70)OP(71)OP(72)OP(73)OP(74)OP(75)OP(76)OP(77)OP(78)OP(79)OP(7A)OP(7B)OP(7C)OP(7D)OP(7E)OP(7F)
+    OP(80)OP(81)OP(82)OP(83)OP(84)OP(85)OP(86)OP(87)OP(88)OP(89)OP(8A)OP(8B)OP(8C)OP(8D)OP(8E)OP(8F)
+    OP(90)OP(91)OP(92)OP(93)OP(94)OP(95)OP(96)OP(97)OP(98)OP(99)OP(9A)OP(9B)OP(9C)OP(9D)OP(9E)OP(9F)
+    OP(A0)OP(A1)OP(A2)OP(A3)OP(A4)OP(A5)OP(A6)OP(A7)OP(A8)OP(A9)OP(AA)OP(AB)OP(AC)OP(AD)OP(AE)OP(AF)
+    OP(B0)OP(B1)OP(B2)OP(B3)OP(B4)OP(B5)OP(B6)OP(B7)OP(B8)OP(B9)OP(BA)OP(BB)OP(BC)OP(BD)OP(BE)OP(BF)
+    OP(C0)OP(C1)OP(C2)OP(C3)OP(C4)OP(C5)OP(C6)OP(C7)OP(C8)OP(C9)OP(CA)OP(CB)OP(CC)OP(CD)OP(CE)OP(CF)
+    OP(D0)OP(D1)OP(D2)OP(D3)OP(D4)OP(D5)OP(D6)OP(D7)OP(D8)OP(D9)OP(DA)OP(DB)OP(DC)OP(DD)OP(DE)OP(DF)
+    OP(E0)OP(E1)OP(E2)OP(E3)OP(E4)OP(E5)OP(E6)OP(E7)OP(E8)OP(E9)OP(EA)OP(EB)OP(EC)OP(ED)OP(EE)OP(EF)
+    OP(F0)OP(F1)OP(F2)OP(F3)OP(F4)OP(F5)OP(F6)OP(F7)OP(F8)OP(F9)OP(FA)OP(FB)OP(FC)OP(FD)OP(FE)OP(FF)
+
+    OP0F(00)OP0F(01)OP0F(02)OP0F(03)OP0F(04)OP0F(05)OP0F(06)OP0F(07)OP0F(08)OP0F(09)OP0F(0A)OP0F(0B)OP0F(0C)OP0F(0D)OP0F(0E)OP0F(0F)
+    OP0F(10)OP0F(11)OP0F(12)OP0F(13)OP0F(14)OP0F(15)OP0F(16)OP0F(17)OP0F(18)OP0F(19)OP0F(1A)OP0F(1B)OP0F(1C)OP0F(1D)OP0F(1E)OP0F(1F)
+    OP0F(20)OP0F(21)OP0F(22)OP0F(23)OP0F(24)OP0F(25)OP0F(26)OP0F(27)OP0F(28)OP0F(29)OP0F(2A)OP0F(2B)OP0F(2C)OP0F(2D)OP0F(2E)OP0F(2F)
+    OP0F(30)OP0F(31)OP0F(32)OP0F(33)OP0F(34)OP0F(35)OP0F(36)OP0F(37)OP0F(38)OP0F(39)OP0F(3A)OP0F(3B)OP0F(3C)OP0F(3D)OP0F(3E)OP0F(3F)
+    OP0F(40)OP0F(41)OP0F(42)OP0F(43)OP0F(44)OP0F(45)OP0F(46)OP0F(47)OP0F(48)OP0F(49)OP0F(4A)OP0F(4B)OP0F(4C)OP0F(4D)OP0F(4E)OP0F(4F)
+    OP0F(50)OP0F(51)OP0F(52)OP0F(53)OP0F(54)OP0F(55)OP0F(56)OP0F(57)OP0F(58)OP0F(59)OP0F(5A)OP0F(5B)OP0F(5C)OP0F(5D)OP0F(5E)OP0F(5F)
+    OP0F(60)OP0F(61)OP0F(62)OP0F(63)OP0F(64)OP0F(65)OP0F(66)OP0F(67)OP0F(68)OP0F(69)OP0F(6A)OP0F(6B)OP0F(6C)OP0F(6D)OP0F(6E)OP0F(6F)
+    OP0F(70)OP0F(71)OP0F(72)OP0F(73)OP0F(74)OP0F(75)OP0F(76)OP0F(77)OP0F(78)OP0F(79)OP0F(7A)OP0F(7B)OP0F(7C)OP0F(7D)OP0F(7E)OP0F(7F)
+    OP0F(80)OP0F(81)OP0F(82)OP0F(83)OP0F(84)OP0F(85)OP0F(86)OP0F(87)OP0F(88)OP0F(89)OP0F(8A)OP0F(8B)OP0F(8C)OP0F(8D)OP0F(8E)OP0F(8F)
+    OP0F(90)OP0F(91)OP0F(92)OP0F(93)OP0F(94)OP0F(95)OP0F(96)OP0F(97)OP0F(98)OP0F(99)OP0F(9A)OP0F(9B)OP0F(9C)OP0F(9D)OP0F(9E)OP0F(9F)
+    OP0F(A0)OP0F(A1)OP0F(A2)OP0F(A3)OP0F(A4)OP0F(A5)OP0F(A6)OP0F(A7)OP0F(A8)OP0F(A9)OP0F(AA)OP0F(AB)OP0F(AC)OP0F(AD)OP0F(AE)OP0F(AF)
+    OP0F(B0)OP0F(B1)OP0F(B2)OP0F(B3)OP0F(B4)OP0F(B5)OP0F(B6)OP0F(B7)OP0F(B8)OP0F(B9)OP0F(BA)OP0F(BB)OP0F(BC)OP0F(BD)OP0F(BE)OP0F(BF)
+    OP0F(C0)OP0F(C1)OP0F(C2)OP0F(C3)OP0F(C4)OP0F(C5)OP0F(C6)OP0F(C7)OP0F(C8)OP0F(C9)OP0F(CA)OP0F(CB)OP0F(CC)OP0F(CD)OP0F(CE)OP0F(CF)
+    OP0F(D0)OP0F(D1)OP0F(D2)OP0F(D3)OP0F(D4)OP0F(D5)OP0F(D6)OP0F(D7)OP0F(D8)OP0F(D9)OP0F(DA)OP0F(DB)OP0F(DC)OP0F(DD)OP0F(DE)OP0F(DF)
+    OP0F(E0)OP0F(E1)OP0F(E2)OP0F(E3)OP0F(E4)OP0F(E5)OP0F(E6)OP0F(E7)OP0F(E8)OP0F(E9)OP0F(EA)OP0F(EB)OP0F(EC)OP0F(ED)OP0F(EE)OP0F(EF)
+    OP0F(F0)OP0F(F1)OP0F(F2)OP0F(F3)OP0F(F4)OP0F(F5)OP0F(F6)OP0F(F7)OP0F(F8)OP0F(F9)OP0F(FA)OP0F(FB)OP0F(FC)OP0F(FD)OP0F(FE)OP0F(FF)
+
+#undef OP0F
+#undef OP
 };
 
 inline u8 getMask(u8 val, u8 start, u8 end) {
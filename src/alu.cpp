@@ -1,92 +1,86 @@
 #include "../inc/alu.hpp"
 #include "../inc/x64.hpp"
 
-template<typename T>
-static u8 get_parity(T res) {
-    res ^= res >> 4;
-    res ^= res >> 2;
-    res ^= res >> 1;
-    return !(res & 1);
+static u8 get_parity(u64 res) {
+    u8 val = res & 0xFF;
+    val ^= val >> 4;
+    val ^= val >> 2;
+    val ^= val >> 1;
+    return !(val & 1);
 }
 
-void add(CPU *cpu, RegType type, const Reg *a, const Reg *b, Reg *result) {
-    calcOp(cpu, type, a, b, result, [](CPU *cpu, auto a, auto b) {
-        using T = decltype(a);
-        
-        T res = a + b;
-        constexpr int bits = sizeof(T) * 8;
+bool LazyFlags::cf() const {
+    switch (this->op) {
+        default: return false;
 
-        u64 topbit = (1ULL << (bits - 1));
-
-        cpu->RFLAGS.cf = (res < a);
-        cpu->RFLAGS.pf = get_parity<T>(res);
-        cpu->RFLAGS.af = ((a ^ b ^ res) & 0x10) != 0;
-        cpu->RFLAGS.zf = (res == 0);
-        cpu->RFLAGS.sf = (res >> (bits - 1)) & 1;
-        cpu->RFLAGS.of = (((a ^ b) & topbit) == 0) && (((a ^ res) & topbit) != 0);
-
-        return res;
-    });
+        case FlagOp::ADD: return (this->res < this->a) || (this->carry && this->res == this->a);
+        case FlagOp::SUB: return (this->a < this->b) || (this->carry && this->a == this->b);
+        case FlagOp::SHL: return (this->b <= this->bits) && ((this->a >> (this->bits - this->b)) & 1);
+    }
 }
 
-void sub(CPU *cpu, RegType type, const Reg *a, const Reg *b, Reg *result) {
-    calcOp(cpu, type, a, b, result, [](CPU *cpu, auto a, auto b) {
-        using T = decltype(a);
-        
-        T res = a - b;
-        constexpr int bits = sizeof(T) * 8;
+bool LazyFlags::pf() const {
+    return get_parity(this->res);
+}
 
-        u64 topbit = (1ULL << (bits - 1));
+bool LazyFlags::af() const {
+    switch (this->op) {
+        default: return false;
 
-        cpu->RFLAGS.cf = (a < b);
-        cpu->RFLAGS.pf = get_parity<T>(res);
-        cpu->RFLAGS.af = ((a ^ b ^ res) & 0x10) != 0;
-        cpu->RFLAGS.zf = (res == 0);
-        cpu->RFLAGS.sf = (res >> (bits - 1)) & 1;
-        cpu->RFLAGS.of = (((a ^ b) & topbit) == 0) && (((a ^ res) & topbit) != 0);
+        case FlagOp::ADD:
+        case FlagOp::SUB: return ((this->a ^ this->b ^ this->res) & 0x10) != 0;
+    }
+}
 
-        return res;
-    });
+bool LazyFlags::zf() const {
+    return this->res == 0;
 }
 
-void xorF(CPU *cpu, RegType type, const Reg *a, const Reg *b, Reg *result) {
-    calcOp(cpu, type, a, b, result, [](CPU *cpu, auto a, auto b) {
-        using T = decltype(a);
-        
-        T res = a ^ b;
-        constexpr int bits = sizeof(T) * 8;
+bool LazyFlags::sf() const {
+    return (this->res >> (this->bits - 1)) & 1;
+}
 
-        u64 topbit = (1ULL << (bits - 1));
+bool LazyFlags::of() const {
+    u64 topbit = 1ULL << (this->bits - 1);
 
-        cpu->RFLAGS.cf = 0;
-        cpu->RFLAGS.pf = get_parity<T>(res);
-        cpu->RFLAGS.af = 0;
-        cpu->RFLAGS.zf = (res == 0);
-        cpu->RFLAGS.sf = (res >> (bits - 1)) & 1;
-        cpu->RFLAGS.of = 0;
+    switch (this->op) {
+        default: return false;
 
-        return res;
-    });
+        case FlagOp::ADD: return ((this->a ^ this->res) & (this->b ^ this->res) & topbit) != 0;
+        case FlagOp::SUB: return ((this->a ^ this->b) & (this->a ^ this->res) & topbit) != 0;
+        case FlagOp::SHL: return this->sf() != this->cf();
+    }
 }
 
-void shl(CPU *cpu, RegType type, const Reg *a, const Reg *b, Reg *result) {
-    calcOp(cpu, type, a, b, result, [](CPU *cpu, auto a, auto b) {
-        using T = decltype(a);
-        constexpr int bits = sizeof(T) * 8;
-        
-        T res = a << (b - 1);
-        u8 topbit = getMask(res, bits - 1, bits - 1) & 1;
-        res <<= 1;
-
-        cpu->RFLAGS.cf = topbit;
-        cpu->RFLAGS.pf = get_parity<T>(res);
-        cpu->RFLAGS.af = 0;
-        cpu->RFLAGS.zf = (res == 0);
-        cpu->RFLAGS.sf = getMask(res, bits - 1, bits - 1) & 1;
-        if (b == 1) {
-            cpu->RFLAGS.of = (cpu->RFLAGS.sf == cpu->RFLAGS.cf);
+// jcc condition straight from the operands of a CMP or TEST, without deriving each flag
+bool LazyFlags::cond(u8 cc) const {
+    u8 shift = 64 - this->bits;
+    s64 sa = static_cast<s64>(this->a << shift) >> shift;
+    s64 sb = static_cast<s64>(this->b << shift) >> shift;
+    bool res;
+
+    if (this->op == FlagOp::SUB) {
+        switch (cc >> 1) {
+            default:
+            case 0: res = this->of(); break;
+            case 1: res = this->a <  this->b; break;
+            case 2: res = this->a == this->b; break;
+            case 3: res = this->a <= this->b; break;
+            case 4: res = this->sf(); break;
+            case 5: res = this->pf(); break;
+            case 6: res = sa <  sb; break;
+            case 7: res = sa <= sb; break;
         }
+    } else { // LOGIC, CF and OF are clear
+        switch (cc >> 1) {
+            default:
+            case 0: case 1: res = false; break;
+            case 2: case 3: res = this->res == 0; break;
+            case 4: case 6: res = this->sf(); break;
+            case 5: res = this->pf(); break;
+            case 7: res = this->res == 0 || this->sf(); break;
+        }
+    }
 
-        return res;
-    });
-}
\ No newline at end of file
+    return res ^ (cc & 1);
+}
@@ -0,0 +1,376 @@
+#include "../inc/aot.hpp"
+#include "../inc/os.hpp"
+#include "../inc/ram.hpp"
+#include "../inc/uop.hpp"
+#include "../inc/x64.hpp"
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+
+bool AotPlugin::load(const char *path) {
+    void *lib = OS::openLibrary(path);
+    AotEntry entry = lib ? reinterpret_cast<AotEntry>(OS::findSymbol(lib, ACCUI64_AOT_ENTRY)) : nullptr;
+    AotStampEntry stamp_of = lib ? reinterpret_cast<AotStampEntry>(OS::findSymbol(lib, ACCUI64_AOT_STAMP)) : nullptr;
+    if (!entry) return false;
+
+    const AotStamp *stamp = stamp_of ? stamp_of() : nullptr;
+    if (!stamp || stamp->version != AotStamp::VERSION || stamp->cpu_size != sizeof(CPU)
+        || stamp->flags_size != sizeof(LazyFlags)) {
+        std::cout << "AOT: " << path << " was generated by another build, regenerate it with --aot" << std::endl;
+        return false;
+    }
+
+    u32 count = 0;
+    const AotBlock *list = entry(&count);
+    for (u32 i = 0; i < count; i++) {
+        this->blocks[list[i].addr] = &list[i];
+    }
+    return true;
+}
+
+// anything that does not match falls back to the uop interpreter or the JIT
+AotFunc AotPlugin::find(const IRBlock *block) const {
+    auto it = this->blocks.find(block->addr);
+    if (it == this->blocks.end()) return nullptr;
+
+    const AotBlock *aot = it->second;
+    if (aot->mode != block->mode || aot->len != block->len) return nullptr;
+    if (aot->insts != block->insts.size() || aot->uops != block->uops.size()) return nullptr;
+
+    return (aot->hash == RAM::hash(block->addr, block->len)) ? aot->func : nullptr;
+}
+
+namespace {
+
+static int bitsOf(RegType type) {
+    switch (type) {
+        case RegType::R16: return 16;
+        case RegType::R32: return 32;
+        case RegType::R64: return 64;
+        default:           return 8;
+    }
+}
+
+static const char *fieldOf(RegType type) {
+    switch (type) {
+        case RegType::R8:  return "l";
+        case RegType::R8H: return "h";
+        case RegType::R16: return "x";
+        case RegType::R32: return "e";
+        default:           return "r";
+    }
+}
+
+static const char *flagOpName(AluOp op) {
+    switch (op) {
+        default:
+        case AluOp::ADD: return "FlagOp::ADD";
+        case AluOp::SUB: return "FlagOp::SUB";
+        case AluOp::AND: case AluOp::XOR: return "FlagOp::LOGIC";
+    }
+}
+
+static const char *cOperator(AluOp op) {
+    switch (op) {
+        default:
+        case AluOp::ADD: return " + ";
+        case AluOp::SUB: return " - ";
+        case AluOp::AND: return " & ";
+        case AluOp::XOR: return " ^ ";
+    }
+}
+
+static std::string temp(u8 n) {
+    return "t" + std::to_string(n);
+}
+
+static std::string hex(u64 val) {
+    std::ostringstream s;
+    s << "0x" << std::hex << std::uppercase << val << "ULL";
+    return s.str();
+}
+
+// writes one block as a C++ function doing what runIRBlock() would, with the same
+// NativeExit protocol as the JIT. IP moves are batched until something can observe them
+class AotWriter {
+public:
+    AotWriter(std::ostream &out, const IRBlock *block) : out(out), block(block) {}
+
+    static std::string name(const IRBlock *block) {
+        std::ostringstream s;
+        s << "block_" << std::hex << std::uppercase << block->addr;
+        return s.str();
+    }
+
+    void run() {
+        std::set<u8> temps;
+        for (const Uop &u : this->block->uops) {
+            if (u.kind == UopKind::CONST || u.kind == UopKind::GETREG || u.kind == UopKind::EA
+                || u.kind == UopKind::LOAD || u.kind == UopKind::ALU) {
+                temps.insert(u.dst);
+            }
+        }
+
+        this->out << "static u32 " << name(this->block) << "(CPU *cpu, const DecodedInst *insts, const AotHelpers *h) {\n";
+        if (!temps.empty()) {
+            this->out << "    u64";
+            for (u8 n : temps) this->out << ((n == *temps.begin()) ? " " : ", ") << temp(n);
+            this->out << ";\n";
+        }
+
+        bool ended = false;
+        for (const Uop &u : this->block->uops) {
+            if (this->emit(u)) {
+                ended = true;
+                break;
+            }
+        }
+        if (!ended) {
+            this->flush();
+            this->line("return NATIVE_DONE;");
+        }
+
+        this->out << "}\n\n";
+    }
+
+private:
+    std::ostream &out;
+    const IRBlock *block;
+
+    u64 ip_delta = 0;
+    const Uop *flags_from = nullptr;  // last inline ALU that set flags, BRANCH tests its operands directly
+
+    void line(const std::string &text) {
+        this->out << "    " << text << "\n";
+    }
+
+    std::string cast(RegType type, const std::string &val, bool sign = false) {
+        return "static_cast<" + std::string(sign ? "s" : "u") + std::to_string(bitsOf(type)) + ">(" + val + ")";
+    }
+
+    std::string ipField() const {
+        return (this->block->mode == MODE_REAL) ? "cpu->IP->x" : "cpu->IP->e";
+    }
+
+    u64 ipMask() const {
+        return (this->block->mode == MODE_REAL) ? 0xFFFF : 0xFFFFFFFF;
+    }
+
+    void flush() {
+        if (this->ip_delta & this->ipMask()) this->line(this->ipField() + " += " + hex(this->ip_delta & this->ipMask()) + ";");
+        this->ip_delta = 0;
+    }
+
+    void checkExit(const std::string &call) {
+        this->line("if (u32 exit = " + call + "; exit != NATIVE_NEXT) return exit;");
+    }
+
+    void alu(const Uop &u) {
+        std::string a = temp(u.a), b = temp(u.b), dst = temp(u.dst);
+
+        if (u.op == AluOp::ADC) {
+            this->line(dst + " = h->alu(cpu, " + std::to_string(static_cast<int>(u.op)) + ", " + std::to_string(static_cast<int>(u.type))
+                + ", " + std::to_string(u.flags) + ", " + a + ", " + b + ");");
+            if (u.flags) this->flags_from = nullptr;
+            return;
+        }
+
+        this->line(dst + " = " + cast(u.type, a + cOperator(u.op) + b) + ";");
+        if (u.flags) {
+            this->line("cpu->lazy = { " + std::string(flagOpName(u.op)) + ", " + std::to_string(bitsOf(u.type)) + ", 0, "
+                + cast(u.type, a) + ", " + cast(u.type, b) + ", " + dst + " };");
+            this->flags_from = &u;
+        }
+    }
+
+    // the guest condition straight from the operands of the ALU that set the flags, when that is simple
+    std::string cond(u8 cc) {
+        if (!this->flags_from) return "h->cond(cpu, " + std::to_string(cc) + ")";
+
+        const Uop &f = *this->flags_from;
+        std::string a = cast(f.type, temp(f.a)), b = cast(f.type, temp(f.b)), res = temp(f.dst);
+        std::string sa = cast(f.type, temp(f.a), true), sb = cast(f.type, temp(f.b), true), sres = cast(f.type, res, true);
+
+        switch (cc) {
+            case 0x4: return res + " == 0";
+            case 0x5: return res + " != 0";
+            case 0x8: return sres + " < 0";
+            case 0x9: return sres + " >= 0";
+        }
+
+        if (f.op == AluOp::SUB) {
+            switch (cc) {
+                case 0x2: return a + " < " + b;
+                case 0x3: return a + " >= " + b;
+                case 0x6: return a + " <= " + b;
+                case 0x7: return a + " > " + b;
+                case 0xC: return sa + " < " + sb;
+                case 0xD: return sa + " >= " + sb;
+                case 0xE: return sa + " <= " + sb;
+                case 0xF: return sa + " > " + sb;
+            }
+        } else if (f.op == AluOp::ADD) {
+            switch (cc) {
+                case 0x2: return res + " < " + a;
+                case 0x3: return res + " >= " + a;
+            }
+        } else {
+            // CF and OF are clear after AND and XOR
+            switch (cc) {
+                case 0x2: return "false";
+                case 0x3: return "true";
+                case 0x6: return res + " == 0";
+                case 0x7: return res + " != 0";
+                case 0xC: return sres + " < 0";
+                case 0xD: return sres + " >= 0";
+                case 0xE: return sres + " <= 0";
+                case 0xF: return sres + " > 0";
+            }
+        }
+
+        return "h->cond(cpu, " + std::to_string(cc) + ")";
+    }
+
+    // true once the block has left
+    bool emit(const Uop &u) {
+        std::string inst = "&insts[" + std::to_string(u.inst) + "]";
+
+        switch (u.kind) {
+            case UopKind::NOP: break;
+
+            case UopKind::CONST:
+                this->line(temp(u.dst) + " = " + hex(u.imm) + ";");
+                break;
+
+            case UopKind::GETREG:
+                this->line(temp(u.dst) + " = cpu->regs[" + std::to_string(u.reg) + "]." + fieldOf(u.type) + ";");
+                break;
+
+            case UopKind::SETREG:
+                if (u.type == RegType::R32) {
+                    this->line("cpu->regs[" + std::to_string(u.reg) + "].r = " + cast(u.type, temp(u.a)) + ";");  // 32 bit writes clear the top half
+                } else {
+                    this->line("cpu->regs[" + std::to_string(u.reg) + "]." + fieldOf(u.type) + " = " + cast(u.type, temp(u.a)) + ";");
+                }
+                break;
+
+            case UopKind::EA:
+                this->flush();
+                this->line(temp(u.dst) + " = insts[" + std::to_string(u.inst) + "].ea(cpu, " + inst + ");");
+                break;
+
+            case UopKind::LOAD:
+                this->flush();
+                this->checkExit("h->load(cpu, " + temp(u.a) + ", " + std::to_string(static_cast<int>(u.type)) + ", &" + temp(u.dst) + ")");
+                break;
+
+            case UopKind::STORE:
+                this->flush();
+                this->checkExit("h->store(cpu, " + temp(u.a) + ", " + temp(u.b) + ", " + std::to_string(static_cast<int>(u.type)) + ")");
+                break;
+
+            case UopKind::ALU:
+                this->alu(u);
+                break;
+
+            case UopKind::ZEROFLAGS:
+                this->line("h->zeroFlags(cpu);");
+                this->flags_from = nullptr;
+                break;
+
+            case UopKind::ADVANCE:
+                this->ip_delta += u.imm;
+                break;
+
+            case UopKind::BRANCH:
+                this->flush();
+                this->line("if (" + this->cond(u.cc) + ") " + this->ipField() + " += " + hex(u.imm & this->ipMask()) + ";");
+                this->line("return NATIVE_DONE;");
+                return true;
+
+            case UopKind::JUMP:
+                this->ip_delta += u.imm;
+                this->flush();
+                this->line("return NATIVE_DONE;");
+                return true;
+
+            case UopKind::CALL:
+                this->flush();
+                this->checkExit("h->call(cpu, " + inst + ", " + std::to_string(u.inst == 0) + ")");
+                this->flags_from = nullptr;
+                break;
+        }
+
+        return false;
+    }
+};
+
+} // namespace
+
+// follows the real mode code reachable from the reset vector through the ROM, the only code
+// whose place and mode are known before anything runs, and writes every block it finds as C++.
+// the result is compiled with `-shared -fPIC -I inc` and passed back in as the AOT plugin
+void CPU::buildAOT(const char *path) {
+    u64 base = CS->base;
+
+    std::map<u64, std::unique_ptr<IRBlock>> found;
+    std::deque<u16> work { IP->x };
+
+    while (!work.empty()) {
+        u16 ip = work.front();
+        work.pop_front();
+
+        u64 addr = base + ip;
+        if (!RAM::inROM(addr, 1) || found.count(addr)) continue;
+
+        std::unique_ptr<IRBlock> block = std::make_unique<IRBlock>();
+        this->translateBlock<MODE_REAL>(addr, block.get());
+
+        // successors wrap around the 64 KiB segment like IP does
+        s64 exits[2];
+        int n = runExits<MODE_REAL>(block->insts.back(), exits);
+        for (int i = 0; i < n; i++) {
+            work.push_back(ip + block->len + exits[i]);
+        }
+
+        found[addr] = std::move(block);
+    }
+
+    std::ofstream out(path);
+    if (!out) {
+        std::cout << "AOT: cannot write " << path << std::endl;
+        return;
+    }
+
+    out << "// generated by accui64 --aot, do not edit\n\n";
+    out << "#include \"aot.hpp\"\n\n";
+
+    for (const auto &[addr, block] : found) {
+        AotWriter(out, block.get()).run();
+    }
+
+    out << "static const AotBlock blocks[] = {\n";
+    for (const auto &[addr, block] : found) {
+        out << "    { " << hex(addr) << ", " << hex(RAM::hash(addr, block->len)) << ", " << std::dec << block->len << ", "
+            << block->insts.size() << ", " << block->uops.size() << ", MODE_REAL, " << AotWriter::name(block.get()) << " },\n";
+    }
+    out << "};\n\n";
+
+    out << "static const AotStamp stamp = { " << std::dec << AotStamp::VERSION << ", " << sizeof(CPU) << ", "
+        << sizeof(LazyFlags) << " };\n\n";
+
+    out << "extern \"C\" ACCUI64_AOT_EXPORT const AotStamp *accui64_aot_stamp() {\n";
+    out << "    return &stamp;\n";
+    out << "}\n\n";
+
+    out << "extern \"C\" ACCUI64_AOT_EXPORT const AotBlock *accui64_aot_blocks(u32 *count) {\n";
+    out << "    *count = sizeof(blocks) / sizeof(blocks[0]);\n";
+    out << "    return blocks;\n";
+    out << "}\n";
+
+    std::cout << "AOT: " << std::dec << found.size() << " blocks written to " << path << std::endl;
+}
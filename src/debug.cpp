@@ -42,6 +42,17 @@ static const char *xmm_names[0x8] = {
     "XMM4", "XMM5", "XMM6", "XMM7",
 };
 
+static const char *cond_names[0x10] = {
+    "O",  "NO", "B",  "NB",
+    "Z",  "NZ", "BE", "A",
+    "S",  "NS", "P",  "NP",
+    "L",  "GE", "LE", "G",
+};
+
+const char *getCondName(u8 cc) {
+    return cond_names[cc & 0xF];
+}
+
 const char *getRegName(u8 idx, RegType type) {
     switch (type) {
         default: return "";
@@ -96,8 +107,10 @@ void debugPrintMem(ModRM *modrm, u32 disp) {
         }
     }
     if (modrm->disp != 0) {
-        if (modrm->rm || modrm->sib.idx || modrm->sib.idx) {
-            std::cout << " + ";
+        s32 sdisp = static_cast<s32>(disp);
+        if (modrm->rm || modrm->sib.idx || modrm->sib.base) {
+            std::cout << ((sdisp < 0) ? " - " : " + ");
+            if (sdisp < 0) disp = -sdisp;
         }
         std::cout << disp;
     }
@@ -109,6 +122,8 @@ void debugPrintReg(ModRM *modrm, u32 disp) {
 }
 
 void debugPrint(const char *name, ModRM *modrm, u32 disp, u64 val, OpOrder order) {
+    if (!std::cout) return;  // muted by the fast tier
+
     std::cout << name << " ";
 
     switch (order) {
@@ -0,0 +1,242 @@
+#include "../inc/hle.hpp"
+#include "../inc/ram.hpp"
+#include "../inc/x64.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+u32 HleCall::arg(int n) const {
+    Reg *const args[] = { cpu->AX, cpu->DX, cpu->CX };
+    return args[n]->e;
+}
+
+void HleCall::ret(u32 val) {
+    cpu->AX->e = val;
+}
+
+u8 HleCall::read(u32 ptr) const {
+    return RAM::read(cpu->DS->base + ptr);
+}
+
+void HleCall::write(u32 ptr, u8 val) {
+    u64 addr = cpu->DS->base + ptr;
+    if (this->journal) this->undo.push_back({ addr, RAM::read(addr) });
+    RAM::write(addr, val);
+}
+
+namespace {
+
+// void *memset(void *s, int c, size_t n)
+static void hleMemset(HleCall &call) {
+    u32 dst = call.arg(0), n = call.arg(2);
+    u8 c = call.arg(1);
+
+    for (u32 i = 0; i < n; i++) call.write(dst + i, c);
+    call.ret(dst);
+}
+
+// void *memcpy(void *d, const void *s, size_t n), forwards like the usual rep movsb
+static void hleMemcpy(HleCall &call) {
+    u32 dst = call.arg(0), src = call.arg(1), n = call.arg(2);
+
+    for (u32 i = 0; i < n; i++) call.write(dst + i, call.read(src + i));
+    call.ret(dst);
+}
+
+// void *memmove(void *d, const void *s, size_t n)
+static void hleMemmove(HleCall &call) {
+    u32 dst = call.arg(0), src = call.arg(1), n = call.arg(2);
+
+    if (dst - src >= n) {
+        for (u32 i = 0; i < n; i++) call.write(dst + i, call.read(src + i));
+    } else {
+        for (u32 i = n; i-- > 0;) call.write(dst + i, call.read(src + i));
+    }
+    call.ret(dst);
+}
+
+// u8 checksum(void *buf, u32 len), the byte sum every BIOS table is checked with
+static void hleChecksum(HleCall &call) {
+    u32 buf = call.arg(0), len = call.arg(1);
+    u8 sum = 0;
+
+    for (u32 i = 0; i < len; i++) sum += call.read(buf + i);
+    call.ret(sum);
+}
+
+static bool parseBytes(const std::string &hex, std::vector<u8> &out) {
+    if (hex.empty() || hex.size() % 2) return false;
+
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        char byte[3] = { hex[i], hex[i + 1], 0 };
+        char *end;
+        out.push_back(std::strtoul(byte, &end, 16));
+        if (*end) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+HleFunc HleRegistry::builtin(const std::string &name) {
+    static const struct { const char *name; HleFunc func; } funcs[] = {
+        { "memset",   hleMemset },
+        { "memcpy",   hleMemcpy },
+        { "memmove",  hleMemmove },
+        { "checksum", hleChecksum },
+    };
+
+    for (const auto &func : funcs) {
+        if (name == func.name) return func.func;
+    }
+    return nullptr;
+}
+
+// NAME@0xADDR binds a builtin to a linear address, NAME@BYTES to the ROM code starting with those hex bytes
+bool HleRegistry::add(const std::string &spec) {
+    size_t at = spec.find('@');
+    if (at == std::string::npos) return false;
+
+    HleHook hook;
+    hook.name = spec.substr(0, at);
+    hook.func = builtin(hook.name);
+    if (!hook.func) return false;
+
+    std::string where = spec.substr(at + 1);
+    if (where.rfind("0x", 0) == 0 || where.rfind("0X", 0) == 0) {
+        char *end;
+        hook.addr = std::strtoull(where.c_str(), &end, 16);
+        if (*end) return false;
+    } else if (!parseBytes(where, hook.sig)) {
+        return false;
+    }
+
+    this->hooks.push_back(hook);
+    return true;
+}
+
+// finds the signature hooks in the loaded ROM, the first match wins
+void HleRegistry::resolve() {
+    const u64 top = RAM::TOP_4G;
+
+    for (HleHook &hook : this->hooks) {
+        if (!hook.sig.empty()) {
+            const u8 *rom = RAM::rom_image;
+            const u8 *hit = std::search(rom, rom + RAM::rom_size, hook.sig.begin(), hook.sig.end());
+
+            if (hit == rom + RAM::rom_size) {
+                std::cout << "HLE: " << hook.name << " not found" << std::endl;
+                continue;
+            }
+            hook.addr = top - RAM::rom_size + (hit - rom);
+        }
+
+        std::cout << "HLE: " << hook.name << " at 0x" << std::hex << std::uppercase << hook.addr << std::endl;
+        if (hook.enabled) this->entries[hook.addr] = &hook - this->hooks.data();
+    }
+}
+
+void HleRegistry::setEnabled(const std::string &name, bool on) {
+    for (HleHook &hook : this->hooks) {
+        if (hook.name != name || hook.addr == ~0ULL) continue;
+
+        hook.enabled = on;
+        if (on) {
+            this->entries[hook.addr] = &hook - this->hooks.data();
+        } else {
+            this->entries.erase(hook.addr);
+        }
+    }
+}
+
+// runs the hook for a routine entered at CS:IP in place of the guest code, false when there is none
+bool HleRegistry::enter(CPU *cpu) {
+    auto it = this->entries.find(cpu->CS->base + cpu->IP->e);
+    if (it == this->entries.end()) return false;
+
+    HleHook &hook = this->hooks[it->second];
+    hook.calls++;
+
+    if (this->verify) {
+        this->check(cpu, hook);
+        return true;
+    }
+
+    HleCall call(cpu);
+    hook.func(call);
+    leave(cpu);
+
+    std::cout << "HLE " << hook.name << std::endl;
+    return true;
+}
+
+void HleRegistry::report() const {
+    for (const HleHook &hook : this->hooks) {
+        std::cout << "HLE: " << hook.name << " " << std::dec << hook.calls << " calls"
+                  << (hook.enabled ? "" : ", disabled") << std::endl;
+    }
+}
+
+// the near RET at the end of the routine
+void HleRegistry::leave(CPU *cpu) {
+    switch (cpu->mode) {
+        case MODE_REAL: cpu->IP->x = cpu->pop(RegType::R16); break;
+        case MODE_PROT: cpu->IP->e = cpu->pop(RegType::R32); break;
+        case MODE_LONG: cpu->IP->r = cpu->pop(RegType::R64); break;
+    }
+}
+
+// runs the hook, takes its stores back, then runs the guest's own routine up to the same return and
+// compares what the ABI keeps: EAX, the callee saved registers, ESP and EIP, and every byte the hook
+// stored. stores only the original makes go unnoticed. a hook that disagrees is disabled, either way
+// the original's result is the one that stays
+void HleRegistry::check(CPU *cpu, HleHook &hook) {
+    Reg saved[17], native[17];
+    std::copy(cpu->regs, cpu->regs + 17, saved);
+
+    HleCall call(cpu, true);
+    hook.func(call);
+    leave(cpu);
+
+    std::copy(cpu->regs, cpu->regs + 17, native);
+    std::vector<u8> stored;
+    for (const auto &[addr, old] : call.undo) stored.push_back(RAM::read(addr));
+
+    for (auto it = call.undo.rbegin(); it != call.undo.rend(); it++) RAM::write(it->first, it->second);
+    std::copy(saved, saved + 17, cpu->regs);
+
+    // the original prints every instruction it runs, none of that belongs in the trace
+    std::ios::iostate state = std::cout.rdstate();
+    std::cout.setstate(std::ios::badbit);
+
+    u64 steps = 0;
+    try {
+        while (cpu->running && steps < VERIFY_STEPS) {
+            if (cpu->IP->e == native[16].e && cpu->SP->e == native[4].e) break;
+            cpu->fetchInst();
+            cpu->execute();
+            steps++;
+        }
+    } catch (...) {
+        std::cout.clear(state);
+        throw;
+    }
+    std::cout.clear(state);
+
+    bool same = steps < VERIFY_STEPS;
+    for (int reg : { 0, 3, 4, 5, 6, 7, 16 }) {
+        same &= cpu->regs[reg].e == native[reg].e;
+    }
+    for (size_t i = 0; i < stored.size(); i++) {
+        same &= RAM::read(call.undo[i].first) == stored[i];
+    }
+
+    if (same) {
+        std::cout << "HLE " << hook.name << " VERIFIED" << std::endl;
+        return;
+    }
+
+    std::cout << "HLE " << hook.name << " MISMATCH AFTER " << std::dec << steps << " STEPS, DISABLED" << std::endl;
+    this->setEnabled(hook.name, false);
+}
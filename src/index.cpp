@@ -0,0 +1,183 @@
+#include "../inc/index.hpp"
+#include "../inc/os.hpp"
+#include "../inc/ram.hpp"
+#include "../inc/uop.hpp"
+#include "../inc/x64.hpp"
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+enum IndexFeature : u32 {
+    INDEX_NO_FUSION = 1 << 0,
+    INDEX_IR        = 1 << 1,
+};
+
+static constexpr u32 index_features = 0
+#ifdef ACCUI64_NO_FUSION
+    | INDEX_NO_FUSION
+#endif
+#if defined(ACCUI64_IR) || defined(ACCUI64_JIT) || defined(ACCUI64_AOT)
+    | INDEX_IR
+#endif
+    ;
+
+// named after the image, so every copy of one ROM shares its index
+static std::string indexPath() {
+    std::ostringstream s;
+    s << "accui64-" << std::hex << std::uppercase << std::setw(16) << std::setfill('0') << RAM::rom_hash << ".idx";
+    return s.str();
+}
+
+bool CPU::packInst(const DecodedInst &inst, IndexInst &out) const {
+    const void *ptrs[4] = { inst.modrm.rm, inst.modrm.reg, inst.modrm.sib.idx, inst.modrm.sib.base };
+
+    out.inst = inst;
+    out.inst.modrm.rm = out.inst.modrm.reg = nullptr;
+    out.inst.modrm.sib.idx = out.inst.modrm.sib.base = nullptr;
+    out.inst.ea = nullptr;
+    out.inst.gen[0] = out.inst.gen[1] = 0;
+
+    for (int i = 0; i < 4; i++) {
+        u64 at = static_cast<const u8 *>(ptrs[i]) - reinterpret_cast<const u8 *>(this);
+        if (ptrs[i] && at >= sizeof(CPU)) return false;
+
+        out.ptrs[i] = ptrs[i] ? static_cast<s32>(at) : -1;
+    }
+    return true;
+}
+
+// the pointers back, ea picked again the way the decoder did
+DecodedInst CPU::unpackInst(const IndexInst &packed) {
+    DecodedInst inst = packed.inst;
+    u8 *base = reinterpret_cast<u8 *>(this);
+    auto at = [base](s32 off) { return (off < 0) ? nullptr : base + off; };
+
+    inst.modrm.rm  = at(packed.ptrs[0]);
+    inst.modrm.reg = at(packed.ptrs[1]);
+    inst.modrm.sib.idx  = reinterpret_cast<Reg *>(at(packed.ptrs[2]));
+    inst.modrm.sib.base = reinterpret_cast<Reg *>(at(packed.ptrs[3]));
+    inst.gen[0] = RAM::pageGen(inst.addr);
+    inst.gen[1] = RAM::pageGen(inst.addr + inst.len - 1);
+
+    if (inst.has_modrm) {
+        this->inst = inst;
+        switch (inst.mode) {
+            case MODE_REAL: this->selectEA<MODE_REAL>(); break;
+            case MODE_PROT: this->selectEA<MODE_PROT>(); break;
+            case MODE_LONG: this->selectEA<MODE_LONG>(); break;
+        }
+        inst = this->inst;
+        this->inst = DecodedInst();
+    }
+
+    return inst;
+}
+
+// maps the index an earlier run with this ROM left and fills the decode caches from it, so
+// nothing decoded then is decoded again. false when there is none or it does not fit this build
+bool CPU::loadIndex() {
+    u64 size = 0;
+    const u8 *data = OS::mapFile(indexPath().c_str(), &size);
+    if (!data) return false;
+
+    const IndexHeader *header = reinterpret_cast<const IndexHeader *>(data);
+
+    bool ok = size >= sizeof(IndexHeader)
+        && header->magic == IndexHeader::MAGIC && header->version == IndexHeader::VERSION
+        && header->rom_hash == RAM::rom_hash && header->features == index_features
+        && header->inst_size == sizeof(IndexInst) && header->cpu_size == sizeof(CPU)
+        && size == sizeof(IndexHeader) + header->blocks * sizeof(IndexBlock) + header->insts * sizeof(IndexInst);
+
+    const IndexBlock *blocks = reinterpret_cast<const IndexBlock *>(header + 1);
+    const IndexInst *insts   = ok ? reinterpret_cast<const IndexInst *>(blocks + header->blocks) : nullptr;
+
+    for (u32 i = 0; ok && i < header->blocks; i++) {
+        ok = blocks[i].count && blocks[i].count <= MAX_BLOCK && blocks[i].first + blocks[i].count <= header->insts;
+    }
+
+    if (ok) {
+        std::vector<DecodedInst> unpacked(header->insts);
+        for (u32 i = 0; i < header->insts; i++) {
+            unpacked[i] = this->unpackInst(insts[i]);
+            if (unpacked[i].len <= sizeof(unpacked[i].bytes)) {
+                this->icache.insert(unpacked[i]);
+            }
+        }
+
+        if (header->blocks && !this->ir_cache) {
+            this->ir_cache = new IRCache();
+        }
+        for (u32 i = 0; i < header->blocks; i++) {
+            const IndexBlock &block = blocks[i];
+            IRBlock *slot = this->ir_cache->slot(block.addr);
+            const DecodedInst *run = &unpacked[block.first];
+
+            switch (block.mode) {
+                case MODE_REAL: this->translateBlock<MODE_REAL>(block.addr, slot, run, block.count); break;
+                case MODE_PROT: this->translateBlock<MODE_PROT>(block.addr, slot, run, block.count); break;
+                case MODE_LONG: this->translateBlock<MODE_LONG>(block.addr, slot, run, block.count); break;
+            }
+        }
+
+        std::cout << "INDEX: " << std::dec << header->insts << " instructions, " << header->blocks << " blocks" << std::endl;
+    }
+
+    OS::unmapFile(data, size);
+    return ok;
+}
+
+// writes what was decoded from the ROM during this run for loadIndex(). instances launched
+// together may all get here, each writes its own file and the rename is what makes it visible
+void CPU::saveIndex() {
+    std::vector<IndexBlock> blocks;
+    std::vector<IndexInst> insts;
+    IndexInst packed;
+
+    if (this->ir_cache) {
+        this->ir_cache->forEach([&](const IRBlock &block) {
+            if (!RAM::inROM(block.addr, block.len)) return;
+
+            IndexBlock entry = { block.addr, block.mode, static_cast<u32>(insts.size()), static_cast<u32>(block.insts.size()) };
+            for (const DecodedInst &inst : block.insts) {
+                if (!this->packInst(inst, packed)) {
+                    insts.resize(entry.first);
+                    return;
+                }
+                insts.push_back(packed);
+            }
+            blocks.push_back(entry);
+        });
+    }
+
+    this->icache.forEach([&](const DecodedInst &inst) {
+        if (RAM::inROM(inst.addr, inst.len) && this->packInst(inst, packed)) insts.push_back(packed);
+    });
+
+    if (insts.empty()) return;
+
+    IndexHeader header = {
+        IndexHeader::MAGIC, IndexHeader::VERSION, RAM::rom_hash, sizeof(IndexInst), sizeof(CPU), index_features,
+        static_cast<u32>(blocks.size()), static_cast<u32>(insts.size()),
+    };
+
+    std::string path = indexPath();
+    std::string tmp  = path + "." + std::to_string(std::random_device()()) + ".tmp";
+
+    std::ofstream out(tmp, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(blocks.data()), blocks.size() * sizeof(IndexBlock));
+    out.write(reinterpret_cast<const char *>(insts.data()), insts.size() * sizeof(IndexInst));
+    out.close();
+
+    std::error_code err;
+    if (out) {
+        std::filesystem::rename(tmp, path, err);
+    }
+    if (!out || err) {
+        std::filesystem::remove(tmp, err);
+    }
+}
@@ -0,0 +1,573 @@
+#ifdef ACCUI64_JIT
+
+#if !defined(__x86_64__) && !defined(_M_X64)
+#error "ACCUI64_JIT emits x86-64 code and needs an x86-64 host"
+#endif
+
+#include "../inc/jit.hpp"
+#include "../inc/os.hpp"
+#include "../inc/reg.hpp"
+#include "../inc/uop.hpp"
+#include "../inc/x64.hpp"
+#include <cstring>
+#include <vector>
+
+namespace host {
+
+enum GPR : u8 { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+#ifdef _WIN32
+constexpr GPR ARG[4] = { RCX, RDX, R8, R9 };
+#else
+constexpr GPR ARG[4] = { RDI, RSI, RDX, RCX };
+#endif
+
+// callee saved, the most used guest GPRs of a block live here while it runs. R15 holds the CPU
+constexpr GPR CACHED[5] = { RBX, RBP, R12, R13, R14 };
+constexpr GPR SAVED[6]  = { RBX, RBP, R12, R13, R14, R15 };
+
+// shadow space for Win64 callees, then one slot per temp. keeps rsp 16 byte aligned at calls
+constexpr s32 TEMPS = 32;
+constexpr s32 FRAME = TEMPS + 8 * IRBlock::MAX_TEMPS + 8;
+
+class Emitter {
+public:
+    u8 *code;
+    u64 pos = 0;
+
+    explicit Emitter(u8 *code) : code(code) {}
+
+    void byte(u8 val) {
+        this->code[this->pos++] = val;
+    }
+
+    void imm32(u32 val) {
+        std::memcpy(this->code + this->pos, &val, 4);
+        this->pos += 4;
+    }
+
+    void imm64(u64 val) {
+        std::memcpy(this->code + this->pos, &val, 8);
+        this->pos += 8;
+    }
+
+    // byte_regs forces a REX so 4..7 mean SPL..DIL instead of AH..BH
+    void rex(int width, u8 reg, u8 rm, bool byte_regs) {
+        u8 rex = 0x40 | ((width == 64) << 3) | ((reg & 8) >> 1) | ((rm & 8) >> 3);
+        if (rex != 0x40 || byte_regs) this->byte(rex);
+    }
+
+    void modrmMem(u8 reg, GPR base, s32 disp) {
+        this->byte(0x80 | ((reg & 7) << 3) | (base & 7));
+        if ((base & 7) == RSP) this->byte(0x24);
+        this->imm32(disp);
+    }
+
+    // op r/m, reg with two registers, op is the 16/32/64 bit opcode and the 8 bit one is op - 1
+    void rr(u8 op, int width, GPR rm, GPR reg) {
+        if (width == 16) this->byte(0x66);
+        this->rex(width, reg, rm, width == 8 && (rm >= 4 || reg >= 4));
+        this->byte((width == 8) ? op - 1 : op);
+        this->byte(0xC0 | ((reg & 7) << 3) | (rm & 7));
+    }
+
+    // same with [base + disp] as r/m
+    void rm(u8 op, int width, GPR reg, GPR base, s32 disp) {
+        if (width == 16) this->byte(0x66);
+        this->rex(width, reg, base, width == 8 && reg >= 4);
+        this->byte((width == 8) ? op - 1 : op);
+        this->modrmMem(reg, base, disp);
+    }
+
+    void load(GPR reg, GPR base, s32 disp)  { this->rm(0x8B, 64, reg, base, disp); }
+    void store(GPR reg, GPR base, s32 disp) { this->rm(0x89, 64, reg, base, disp); }
+    void mov(GPR dst, GPR src)              { this->rr(0x89, 64, dst, src); }
+
+    void lea(GPR reg, GPR base, s32 disp) {
+        this->rex(64, reg, base, false);
+        this->byte(0x8D);
+        this->modrmMem(reg, base, disp);
+    }
+
+    // zero extends the low width bits of src into dst
+    void movzx(GPR dst, GPR src, int width) {
+        switch (width) {
+            case 8: case 16:
+                this->rex(32, dst, src, width == 8 && src >= 4);
+                this->byte(0x0F);
+                this->byte((width == 8) ? 0xB6 : 0xB7);
+                this->byte(0xC0 | ((dst & 7) << 3) | (src & 7));
+                break;
+
+            case 32: this->rr(0x89, 32, dst, src); break;
+            default: if (dst != src) this->mov(dst, src); break;
+        }
+    }
+
+    void loadZx(GPR dst, int width, GPR base, s32 disp) {
+        switch (width) {
+            case 8: case 16:
+                this->rex(32, dst, base, false);
+                this->byte(0x0F);
+                this->byte((width == 8) ? 0xB6 : 0xB7);
+                this->modrmMem(dst, base, disp);
+                break;
+
+            default: this->rm(0x8B, width, dst, base, disp); break;
+        }
+    }
+
+    void movImm(GPR reg, u64 val) {
+        if (val <= 0xFFFFFFFF) {
+            this->rex(32, 0, reg, false);
+            this->byte(0xB8 + (reg & 7));
+            this->imm32(val);
+        } else {
+            this->rex(64, 0, reg, false);
+            this->byte(0xB8 + (reg & 7));
+            this->imm64(val);
+        }
+    }
+
+    void storeImm8(GPR base, s32 disp, u8 val) {
+        this->rex(32, 0, base, false);
+        this->byte(0xC6);
+        this->modrmMem(0, base, disp);
+        this->byte(val);
+    }
+
+    // C1 group, ext 4 is shl and 5 is shr
+    void shift(u8 ext, int width, GPR reg, u8 count) {
+        this->rex(width, 0, reg, false);
+        this->byte(0xC1);
+        this->byte(0xC0 | (ext << 3) | (reg & 7));
+        this->byte(count);
+    }
+
+    void addEax(u32 val) {
+        this->byte(0x05);
+        this->imm32(val);
+    }
+
+    void cmpEax(u8 val) {
+        this->byte(0x83);
+        this->byte(0xF8);
+        this->byte(val);
+    }
+
+    void adjustRsp(u8 ext, u32 val) {
+        this->byte(0x48);
+        this->byte(0x81);
+        this->byte(0xC0 | (ext << 3) | RSP);
+        this->imm32(val);
+    }
+
+    void push(GPR reg) {
+        if (reg >= 8) this->byte(0x41);
+        this->byte(0x50 + (reg & 7));
+    }
+
+    void pop(GPR reg) {
+        if (reg >= 8) this->byte(0x41);
+        this->byte(0x58 + (reg & 7));
+    }
+
+    void call(const void *func) {
+        this->movImm(RAX, reinterpret_cast<u64>(func));
+        this->byte(0xFF);
+        this->byte(0xD0);
+    }
+
+    // returns where the rel32 goes, for patch()
+    u64 jcc(u8 cc) {
+        this->byte(0x0F);
+        this->byte(0x80 + cc);
+        this->imm32(0);
+        return this->pos - 4;
+    }
+
+    u64 jmp() {
+        this->byte(0xE9);
+        this->imm32(0);
+        return this->pos - 4;
+    }
+
+    void patch(u64 at, u64 target) {
+        u32 rel = target - (at + 4);
+        std::memcpy(this->code + at, &rel, 4);
+    }
+};
+
+} // namespace host
+
+namespace {
+
+using namespace host;
+
+static int widthOf(RegType type) {
+    switch (type) {
+        case RegType::R16: return 16;
+        case RegType::R32: return 32;
+        case RegType::R64: return 64;
+        default:           return 8;
+    }
+}
+
+// the 16/32/64 bit r/m, reg opcode of an ALU uop
+static u8 hostOp(AluOp op) {
+    switch (op) {
+        default:
+        case AluOp::ADD: return 0x01;
+        case AluOp::SUB: return 0x29;
+        case AluOp::AND: return 0x21;
+        case AluOp::XOR: return 0x31;
+    }
+}
+
+static FlagOp flagOp(AluOp op) {
+    switch (op) {
+        default:
+        case AluOp::ADD: return FlagOp::ADD;
+        case AluOp::SUB: return FlagOp::SUB;
+        case AluOp::AND: case AluOp::XOR: return FlagOp::LOGIC;
+    }
+}
+
+// emits one block. code is straight line, so which cached GPRs are dirty and how far IP
+// has moved is known while emitting and only written back before helpers and exits
+template <CPUMode M>
+class BlockCompiler {
+public:
+    BlockCompiler(CPU *cpu, const IRBlock *block, u8 *code) : e(code), cpu(cpu), block(block) {}
+
+    u64 run() {
+        this->pickCached();
+
+        for (GPR reg : SAVED) this->e.push(reg);
+        this->e.adjustRsp(5, FRAME);
+        this->e.mov(R15, ARG[0]);
+        this->reloadRegs();
+
+        bool ended = false;
+        for (const Uop &u : this->block->uops) {
+            if (this->emit(u)) {
+                ended = true;
+                break;
+            }
+        }
+        if (!ended) this->leave(NATIVE_DONE);
+
+        u64 epilogue = this->e.pos;
+        for (u64 at : this->exits) this->e.patch(at, epilogue);
+
+        this->e.adjustRsp(0, FRAME);
+        for (int i = 5; i >= 0; i--) this->e.pop(SAVED[i]);
+        this->e.byte(0xC3);
+
+        return this->e.pos;
+    }
+
+private:
+    Emitter e;
+    CPU *cpu;
+    const IRBlock *block;
+
+    s8 cached[16];
+    bool dirty[16] = {};
+    u64 ip_delta = 0;
+    std::vector<u64> exits;
+
+    // last ALU that set flags, BRANCH redoes it on the host instead of asking LazyFlags
+    const Uop *flags_from = nullptr;
+
+    s32 off(const void *field) const {
+        return static_cast<s32>(reinterpret_cast<const u8 *>(field) - reinterpret_cast<const u8 *>(this->cpu));
+    }
+
+    static s32 slot(u8 temp) {
+        return TEMPS + 8 * temp;
+    }
+
+    void pickCached() {
+        int uses[16] = {};
+        for (const Uop &u : this->block->uops) {
+            if (u.kind == UopKind::GETREG || u.kind == UopKind::SETREG) uses[u.reg]++;
+        }
+
+        std::memset(this->cached, -1, sizeof(this->cached));
+        for (int n = 0; n < 5; n++) {
+            int best = -1;
+            for (int reg = 0; reg < 16; reg++) {
+                if (this->cached[reg] < 0 && uses[reg] > 1 && (best < 0 || uses[reg] > uses[best])) best = reg;
+            }
+            if (best < 0) break;
+            this->cached[best] = n;
+        }
+    }
+
+    void reloadRegs() {
+        for (int reg = 0; reg < 16; reg++) {
+            if (this->cached[reg] >= 0) this->e.load(CACHED[this->cached[reg]], R15, this->off(&this->cpu->regs[reg]));
+        }
+    }
+
+    void flushRegs() {
+        for (int reg = 0; reg < 16; reg++) {
+            if (this->dirty[reg]) this->e.store(CACHED[this->cached[reg]], R15, this->off(&this->cpu->regs[reg]));
+            this->dirty[reg] = false;
+        }
+    }
+
+    void addIP(u64 delta) {
+        s32 ip = this->off(this->cpu->IP);
+
+        this->e.loadZx(RAX, 32, R15, ip);
+        this->e.addEax(delta);
+        this->e.rm(0x89, (M == MODE_REAL) ? 16 : 32, RAX, R15, ip);
+    }
+
+    // everything helpers can see is in memory afterwards
+    void flush() {
+        this->flushRegs();
+        if (this->ip_delta) this->addIP(this->ip_delta);
+        this->ip_delta = 0;
+    }
+
+    void leave(NativeExit exit) {
+        this->flush();
+        this->e.movImm(RAX, exit);
+        this->exits.push_back(this->e.jmp());
+    }
+
+    // after a helper returning NativeExit, anything but NATIVE_NEXT goes straight out
+    void checkExit() {
+        this->e.cmpEax(NATIVE_NEXT);
+        this->exits.push_back(this->e.jcc(0x5));
+    }
+
+    void getReg(const Uop &u) {
+        int width = widthOf(u.type);
+
+        if (this->cached[u.reg] < 0) {
+            s32 reg = this->off(&this->cpu->regs[u.reg]) + (u.type == RegType::R8H);
+            this->e.loadZx(RAX, width, R15, reg);
+            return;
+        }
+
+        GPR src = CACHED[this->cached[u.reg]];
+        if (u.type == RegType::R8H) {
+            this->e.mov(RAX, src);
+            this->e.shift(5, 64, RAX, 8);
+            this->e.movzx(RAX, RAX, 8);
+        } else {
+            this->e.movzx(RAX, src, width);
+        }
+    }
+
+    void setReg(const Uop &u) {
+        int width = widthOf(u.type);
+
+        if (this->cached[u.reg] < 0) {
+            s32 reg = this->off(&this->cpu->regs[u.reg]) + (u.type == RegType::R8H);
+            if (width == 32) {
+                this->e.movzx(RAX, RAX, 32);  // 32 bit writes clear the top half
+                width = 64;
+            }
+            this->e.rm(0x89, width, RAX, R15, reg);
+            return;
+        }
+
+        GPR dst = CACHED[this->cached[u.reg]];
+        if (u.type == RegType::R8H) {
+            this->e.movImm(RCX, ~0xFF00ULL);
+            this->e.rr(0x21, 64, dst, RCX);
+            this->e.movzx(RCX, RAX, 8);
+            this->e.shift(4, 32, RCX, 8);
+            this->e.rr(0x09, 64, dst, RCX);
+        } else {
+            this->e.rr(0x89, width, dst, RAX);
+        }
+        this->dirty[u.reg] = true;
+    }
+
+    void alu(const Uop &u) {
+        int width = widthOf(u.type);
+
+        if (u.op == AluOp::ADC) {
+            this->e.mov(ARG[0], R15);
+            this->e.load(ARG[1], RSP, slot(u.a));
+            this->e.load(ARG[2], RSP, slot(u.b));
+            this->e.call(reinterpret_cast<const void *>(u.alu));
+            this->e.store(RAX, RSP, slot(u.dst));
+            if (u.flags) this->flags_from = nullptr;
+            return;
+        }
+
+        this->e.load(RAX, RSP, slot(u.a));
+        this->e.load(RCX, RSP, slot(u.b));
+        this->e.movzx(RAX, RAX, width);
+        this->e.movzx(RCX, RCX, width);
+        this->e.mov(RDX, RAX);
+        this->e.rr(hostOp(u.op), width, RDX, RCX);
+        this->e.movzx(RDX, RDX, width);
+        this->e.store(RDX, RSP, slot(u.dst));
+
+        if (u.flags) {
+            LazyFlags *lazy = &this->cpu->lazy;
+
+            this->e.storeImm8(R15, this->off(&lazy->op), static_cast<u8>(flagOp(u.op)));
+            this->e.storeImm8(R15, this->off(&lazy->bits), width);
+            this->e.storeImm8(R15, this->off(&lazy->carry), 0);
+            this->e.store(RAX, R15, this->off(&lazy->a));
+            this->e.store(RCX, R15, this->off(&lazy->b));
+            this->e.store(RDX, R15, this->off(&lazy->res));
+            this->flags_from = &u;
+        }
+    }
+
+    void branch(const Uop &u) {
+        this->flush();
+
+        u64 taken;
+        if (this->flags_from) {
+            // same operation at the same width leaves the host flags equal to the guest ones,
+            // so the guest condition code is the host one too. CMP and TEST stand in for SUB and AND
+            const Uop &f = *this->flags_from;
+            u8 op = (f.op == AluOp::SUB) ? 0x39 : (f.op == AluOp::AND) ? 0x85 : hostOp(f.op);
+
+            this->e.load(RAX, RSP, slot(f.a));
+            this->e.load(RCX, RSP, slot(f.b));
+            this->e.rr(op, widthOf(f.type), RAX, RCX);
+            taken = this->e.jcc(u.cc);
+        } else {
+            this->e.mov(ARG[0], R15);
+            this->e.movImm(ARG[1], u.cc);
+            this->e.call(reinterpret_cast<const void *>(nativeCond));
+            this->e.rr(0x85, 32, RAX, RAX);
+            taken = this->e.jcc(0x5);
+        }
+
+        this->leave(NATIVE_DONE);
+        this->e.patch(taken, this->e.pos);
+        this->ip_delta = u.imm;
+        this->leave(NATIVE_DONE);
+    }
+
+    // true once the block has left
+    bool emit(const Uop &u) {
+        switch (u.kind) {
+            case UopKind::NOP: break;
+
+            case UopKind::CONST:
+                this->e.movImm(RAX, u.imm);
+                this->e.store(RAX, RSP, slot(u.dst));
+                break;
+
+            case UopKind::GETREG:
+                this->getReg(u);
+                this->e.store(RAX, RSP, slot(u.dst));
+                break;
+
+            case UopKind::SETREG:
+                this->e.load(RAX, RSP, slot(u.a));
+                this->setReg(u);
+                break;
+
+            case UopKind::EA: {
+                const DecodedInst *inst = &this->block->insts[u.inst];
+
+                this->flush();
+                this->e.mov(ARG[0], R15);
+                this->e.movImm(ARG[1], reinterpret_cast<u64>(inst));
+                this->e.call(reinterpret_cast<const void *>(inst->ea));
+                this->e.store(RAX, RSP, slot(u.dst));
+                break;
+            }
+
+            case UopKind::LOAD:
+                this->flush();
+                this->e.mov(ARG[0], R15);
+                this->e.load(ARG[1], RSP, slot(u.a));
+                this->e.movImm(ARG[2], static_cast<u64>(u.type));
+                this->e.lea(ARG[3], RSP, slot(u.dst));
+                this->e.call(reinterpret_cast<const void *>(nativeLoad<M>));
+                this->checkExit();
+                break;
+
+            case UopKind::STORE:
+                this->flush();
+                this->e.mov(ARG[0], R15);
+                this->e.load(ARG[1], RSP, slot(u.a));
+                this->e.load(ARG[2], RSP, slot(u.b));
+                this->e.movImm(ARG[3], static_cast<u64>(u.type));
+                this->e.call(reinterpret_cast<const void *>(nativeStore<M>));
+                this->checkExit();
+                break;
+
+            case UopKind::ALU:
+                this->alu(u);
+                break;
+
+            case UopKind::ZEROFLAGS:
+                this->e.mov(ARG[0], R15);
+                this->e.call(reinterpret_cast<const void *>(nativeZeroFlags));
+                this->flags_from = nullptr;
+                break;
+
+            case UopKind::ADVANCE:
+                this->ip_delta += u.imm;
+                break;
+
+            case UopKind::BRANCH:
+                this->branch(u);
+                return true;
+
+            case UopKind::JUMP:
+                this->ip_delta += u.imm;
+                this->leave(NATIVE_DONE);
+                return true;
+
+            case UopKind::CALL:
+                this->flush();
+                this->e.mov(ARG[0], R15);
+                this->e.movImm(ARG[1], reinterpret_cast<u64>(&this->block->insts[u.inst]));
+                this->e.movImm(ARG[2], u.inst == 0);
+                this->e.call(reinterpret_cast<const void *>(nativeCall<M>));
+                this->checkExit();
+                this->reloadRegs();
+                this->flags_from = nullptr;
+                break;
+        }
+
+        return false;
+    }
+};
+
+} // namespace
+
+Jit::Jit() {
+    this->buf = OS::allocExec(SIZE);
+}
+
+template <CPUMode M>
+bool Jit::compile(CPU *cpu, IRBlock *block) {
+    if (!this->buf) return false;
+
+    // generous per uop bound, the biggest (BRANCH, CALL) stay well under it
+    u64 bound = 256 + 160 * block->uops.size();
+    if (this->used + bound > SIZE) {
+        this->used = 0;
+        this->epoch++;
+    }
+
+    BlockCompiler<M> compiler(cpu, block, this->buf + this->used);
+    u64 len = compiler.run();
+
+    block->code  = reinterpret_cast<JitFunc>(this->buf + this->used);
+    block->epoch = this->epoch;
+    this->used = (this->used + len + 15) & ~15ULL;
+
+    return true;
+}
+
+#endif
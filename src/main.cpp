@@ -1,22 +1,166 @@
 #include "alu.cpp"
 #include "x64.cpp"
+#include "uop.cpp"
 #include "debug.cpp"
 #include "opcodes/std.cpp"
 #include "opcodes/sub.cpp"
 #include "ram.cpp"
+#include "mmio.cpp"
+#include "aot.cpp"
+#include "index.cpp"
+#include "predecode.cpp"
+#include "hle.cpp"
+#include "jit.cpp"
+#include "os.cpp"
+
+// the options that pick when to switch tiers, each takes one value
+static bool parseTrigger(const std::string &opt, const char *val, std::vector<TierTrigger> &out) {
+    static const struct { const char *name; TierTrigger::Kind kind; Tier to; } options[] = {
+        { "--trace-at",    TierTrigger::ADDR,  Tier::TRACE },
+        { "--trace-after", TierTrigger::COUNT, Tier::TRACE },
+        { "--trace-post",  TierTrigger::POST,  Tier::TRACE },
+        { "--fast-at",     TierTrigger::ADDR,  Tier::FAST },
+        { "--fast-after",  TierTrigger::COUNT, Tier::FAST },
+        { "--fast-post",   TierTrigger::POST,  Tier::FAST },
+    };
+
+    for (const auto &option : options) {
+        if (opt == option.name) {
+            out.push_back({ option.kind, std::strtoull(val, nullptr, 0), option.to });
+            return true;
+        }
+    }
+    return false;
+}
+
+// --ram, --hole and --mmio add to the default memory layout, each takes BASE:SIZE.
+// there are no device models yet, --mmio puts an MmioLog there to see what the firmware probes
+static bool parseRegion(const std::string &opt, const char *val, std::vector<RAM::Region> &out) {
+    RAM::Kind kind;
+    if (opt == "--ram") {
+        kind = RAM::Kind::RAM;
+    } else if (opt == "--hole") {
+        kind = RAM::Kind::HOLE;
+    } else if (opt == "--mmio") {
+        kind = RAM::Kind::MMIO;
+    } else {
+        return false;
+    }
+
+    char *end;
+    u64 base = std::strtoull(val, &end, 0);
+    if (*end != ':') return false;
+    u64 size = std::strtoull(end + 1, &end, 0);
+    if (*end || !size) return false;
+
+    // devices get offsets from the page the region is widened to
+    MmioDevice *log = (kind == RAM::Kind::MMIO) ? new MmioLog(base & ~(RAM::PAGE - 1)) : nullptr;
+    out.push_back({ base, size, kind, log });
+    return true;
+}
 
 int main(int argc, char *argv[]) {
+    std::vector<const char *> args;
+    std::vector<TierTrigger> triggers;
+    std::vector<RAM::Region> layout;
+    bool fast = false;
+#ifdef ACCUI64_HLE
+    std::vector<std::string> hooks;
+    bool verify = false;
+#endif
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--fast") {
+            fast = true;
+#ifdef ACCUI64_HLE
+        } else if (arg == "--hle-verify") {
+            verify = true;
+        } else if (arg == "--hle" && i + 1 < argc) {
+            hooks.push_back(argv[++i]);
+#else
+        } else if (arg == "--hle" || arg == "--hle-verify") {
+            std::cout << "HLE: not built in, rebuild with ACCUI64_HLE" << std::endl;
+            return 1;
+#endif
+        } else if (i + 1 < argc && parseTrigger(arg, argv[i + 1], triggers)) {
+            i++;
+        } else if (i + 1 < argc && parseRegion(arg, argv[i + 1], layout)) {
+            i++;
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+
+    // a trigger that starts tracing fast forwards up to it
+    for (const TierTrigger &trigger : triggers) {
+        fast |= trigger.to == Tier::TRACE;
+    }
 
-    if (argc < 2) {
-        std::cout << "USAGE: accui64.exe [FILENAME]" << std::endl;
+    if (args.empty() || (std::string(args[0]) == "--aot" && args.size() < 3)) {
+        std::cout << "USAGE: accui64.exe [OPTIONS] [FILENAME] [AOT PLUGIN]" << std::endl;
+        std::cout << "       accui64.exe --aot [FILENAME] [OUTPUT.cpp]" << std::endl;
+        std::cout << "OPTIONS: --fast, --trace-at ADDR, --trace-after COUNT, --trace-post CODE," << std::endl;
+        std::cout << "         --fast-at ADDR, --fast-after COUNT, --fast-post CODE," << std::endl;
+        std::cout << "         --hle NAME@0xADDR, --hle NAME@BYTES, --hle-verify," << std::endl;
+        std::cout << "         --ram BASE:SIZE, --hole BASE:SIZE, --mmio BASE:SIZE" << std::endl;
         return 1;
     }
 
-    RAM::load(argv[1]);
-    if (RAM::data == nullptr) return 1;
+    if (std::string(args[0]) == "--aot") {
+        if (!RAM::load(args[1])) return 1;
+
+        CPU *cpu = new CPU();
+        cpu->buildAOT(args[2]);
+        return 0;
+    }
+
+    if (!RAM::load(args[0], layout)) return 1;
 
     CPU *cpu = new CPU();
+#ifdef ACCUI64_AOT
+    if (args.size() > 1) {
+        cpu->aot = new AotPlugin();
+        if (!cpu->aot->load(args[1])) {
+            std::cout << "AOT: cannot load " << args[1] << std::endl;
+            return 1;
+        }
+    }
+#endif
+#ifdef ACCUI64_INDEX
+    bool warm = cpu->loadIndex();
+#endif
+#ifdef ACCUI64_PREDECODE
+    cpu->predecoder = new Predecoder(cpu->CS->base, cpu->IP->x);
+#endif
+#ifdef ACCUI64_HLE
+    if (!hooks.empty()) {
+        cpu->hle = new HleRegistry();
+        cpu->hle->verify = verify;
+        for (const std::string &hook : hooks) {
+            if (!cpu->hle->add(hook)) {
+                std::cout << "HLE: bad hook " << hook << std::endl;
+                return 1;
+            }
+        }
+        cpu->hle->resolve();
+    }
+#endif
+    cpu->triggers = triggers;
+    if (fast) cpu->setTier(Tier::FAST);
+
     cpu->run();
+#ifdef ACCUI64_HLE
+    if (cpu->hle) cpu->hle->report();
+#endif
+#ifdef ACCUI64_PREDECODE
+    delete cpu->predecoder;
+    cpu->predecoder = nullptr;
+#endif
+#ifdef ACCUI64_INDEX
+    if (!warm) cpu->saveIndex();
+#endif
 
     return 0;
-}
\ No newline at end of file
+}
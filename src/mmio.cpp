@@ -0,0 +1,12 @@
+#include "../inc/mmio.hpp"
+#include <iostream>
+
+u64 MmioLog::read(u64 offset, u32 width) {
+    std::cout << "MMIO READ " << std::dec << width << " AT 0x" << std::hex << std::uppercase << (this->base + offset) << std::endl;
+    return ~0ULL >> (64 - width * 8);
+}
+
+void MmioLog::write(u64 offset, u64 val, u32 width) {
+    std::cout << "MMIO WRITE " << std::dec << width << " AT 0x" << std::hex << std::uppercase << (this->base + offset)
+              << " = 0x" << val << std::endl;
+}
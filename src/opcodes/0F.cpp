@@ -1,30 +1,116 @@
 // #include "../../inc/alu.hpp"
 #include "../../inc/x64.hpp"
 #include "../../inc/debug.hpp"
+#include <cstring>
 #include <iostream>
 
+template <CPUMode M>
 bool CPU::OP_0F_22() {
-    u8 modrm_val = this->read();
-    ModRM *modrm = new ModRM(
-        getMask(modrm_val, 7, 6),
-        getMask(modrm_val, 5, 3),
-        getMask(modrm_val, 2, 0)
-    );
+    ModRM *modrm = this->getModRM();
     Reg *dst = &this->regs[modrm->_rm];
     u64 *cr = &this->cr_regs[modrm->_reg];
 
-    RegType type = (this->isLongMode()) ? RegType::R64 : RegType::R32;
+    RegType type = (M == MODE_LONG) ? RegType::R64 : RegType::R32;
     
     *cr &= ~0xFFFFFFFF;
     *cr |= dst->e;
+    this->updateMode();
 
     std::cout << "MOV CR" << (int)modrm->_reg << ", " << getRegName(modrm->_rm, type) << std::endl;
 
     return false;
 }
 
+template <CPUMode M>
+bool CPU::OP_0F_30() {
+    u64 val = (static_cast<u64>(DX->e) << 32) | AX->e;
+
+    switch (CX->e) {
+        case 0xC0000080: {
+            u16 efer = val;
+            u8 lma = IA32_EFER.lma;
+            std::memcpy(&IA32_EFER, &efer, sizeof(IA32_EFER));
+            IA32_EFER.lma = lma;
+            this->updateMode();
+            break;
+        }
+
+        default:
+            std::cout << "UNIMPLEMENTED MSR 0x" << std::hex << std::uppercase << CX->e << std::endl;
+            return this->HALT();
+    }
+
+    std::cout << "WRMSR" << std::endl;
+
+    return false;
+}
+
+template <CPUMode M>
+bool CPU::jccRel() {
+    u8 cc = this->curr_inst & 0xF;
+    s32 rel;
+
+    if (this->getOpSize<M>() == RegType::R16) {
+        rel = (s16)this->getVal16();
+    } else {
+        rel = (s32)this->getVal32();
+    }
+
+    if (this->testCond(cc)) {
+        if constexpr (M == MODE_REAL) {
+            IP->x += rel;
+        } else {
+            IP->e += rel;
+        }
+    }
+
+    std::cout << "J" << getCondName(cc) << " " << std::hex << rel << std::endl;
+
+    return false;
+}
+
+template <CPUMode M>
+bool CPU::setcc() {
+    ModRM *modrm = this->getModRM();
+    u8 cc = this->curr_inst & 0xF;
+    u32 disp;
+    u64 ptr = this->getModRMPtr(modrm, disp);
+    u8 val = this->testCond(cc);
+
+    if (modrm->_mod == 3) {
+        u8 idx = this->inst.pfx.rexB() | modrm->_rm;
+
+        if (!this->inst.pfx.has_rex && idx >= 4 && idx < 8) {
+            this->regs[idx - 4].h = val;
+        } else {
+            this->regs[idx].l = val;
+        }
+    } else {
+        this->write(ptr, val);
+    }
+
+    std::cout << "SET" << getCondName(cc) << " ";
+    debugPrintMem(modrm, disp);
+    std::cout << std::endl;
+
+    return false;
+}
+
+#define JCC_OP_0F(hex) \
+template <CPUMode M> bool CPU::OP_0F_##hex() { return this->jccRel<M>(); }
+#define SETCC_OP_0F(hex) \
+template <CPUMode M> bool CPU::OP_0F_##hex() { return this->setcc<M>(); }
+
+JCC_OP_0F(80)JCC_OP_0F(81)JCC_OP_0F(82)JCC_OP_0F(83)JCC_OP_0F(84)JCC_OP_0F(85)JCC_OP_0F(86)JCC_OP_0F(87)
+JCC_OP_0F(88)JCC_OP_0F(89)JCC_OP_0F(8A)JCC_OP_0F(8B)JCC_OP_0F(8C)JCC_OP_0F(8D)JCC_OP_0F(8E)JCC_OP_0F(8F)
+SETCC_OP_0F(90)SETCC_OP_0F(91)SETCC_OP_0F(92)SETCC_OP_0F(93)SETCC_OP_0F(94)SETCC_OP_0F(95)SETCC_OP_0F(96)SETCC_OP_0F(97)
+SETCC_OP_0F(98)SETCC_OP_0F(99)SETCC_OP_0F(9A)SETCC_OP_0F(9B)SETCC_OP_0F(9C)SETCC_OP_0F(9D)SETCC_OP_0F(9E)SETCC_OP_0F(9F)
+
+#undef SETCC_OP_0F
+#undef JCC_OP_0F
+
 #define STUB_OP_0F(hex) \
-bool CPU::OP_0F_##hex() { std::cout << "UNIMPLEMENTED OPCODE 0x0F 0x" #hex << std::endl; return this->HALT(); }
+template <CPUMode M> bool CPU::OP_0F_##hex() { std::cout << "UNIMPLEMENTED OPCODE 0x0F 0x" #hex << std::endl; return this->HALT(); }
 
 STUB_OP_0F(00)STUB_OP_0F(01)STUB_OP_0F(02)STUB_OP_0F(03)STUB_OP_0F(04)STUB_OP_0F(05)STUB_OP_0F(06)STUB_OP_0F(07)
 STUB_OP_0F(08)STUB_OP_0F(09)STUB_OP_0F(0A)STUB_OP_0F(0B)STUB_OP_0F(0C)STUB_OP_0F(0D)STUB_OP_0F(0E)STUB_OP_0F(0F)
@@ -32,7 +118,7 @@ STUB_OP_0F(10)STUB_OP_0F(11)STUB_OP_0F(12)STUB_OP_0F(13)STUB_OP_0F(14)STUB_OP_0F
 STUB_OP_0F(18)STUB_OP_0F(19)STUB_OP_0F(1A)STUB_OP_0F(1B)STUB_OP_0F(1C)STUB_OP_0F(1D)STUB_OP_0F(1E)STUB_OP_0F(1F)
 STUB_OP_0F(20)STUB_OP_0F(21)STUB_OP_0F(23)STUB_OP_0F(24)STUB_OP_0F(25)STUB_OP_0F(26)STUB_OP_0F(27)
 STUB_OP_0F(28)STUB_OP_0F(29)STUB_OP_0F(2A)STUB_OP_0F(2B)STUB_OP_0F(2C)STUB_OP_0F(2D)STUB_OP_0F(2E)STUB_OP_0F(2F)
-STUB_OP_0F(30)STUB_OP_0F(31)STUB_OP_0F(32)STUB_OP_0F(33)STUB_OP_0F(34)STUB_OP_0F(35)STUB_OP_0F(36)STUB_OP_0F(37)
+STUB_OP_0F(31)STUB_OP_0F(32)STUB_OP_0F(33)STUB_OP_0F(34)STUB_OP_0F(35)STUB_OP_0F(36)STUB_OP_0F(37)
 STUB_OP_0F(38)STUB_OP_0F(39)STUB_OP_0F(3A)STUB_OP_0F(3B)STUB_OP_0F(3C)STUB_OP_0F(3D)STUB_OP_0F(3E)STUB_OP_0F(3F)
 STUB_OP_0F(40)STUB_OP_0F(41)STUB_OP_0F(42)STUB_OP_0F(43)STUB_OP_0F(44)STUB_OP_0F(45)STUB_OP_0F(46)STUB_OP_0F(47)
 STUB_OP_0F(48)STUB_OP_0F(49)STUB_OP_0F(4A)STUB_OP_0F(4B)STUB_OP_0F(4C)STUB_OP_0F(4D)STUB_OP_0F(4E)STUB_OP_0F(4F)
@@ -42,10 +128,6 @@ STUB_OP_0F(60)STUB_OP_0F(61)STUB_OP_0F(62)STUB_OP_0F(63)STUB_OP_0F(64)STUB_OP_0F
 STUB_OP_0F(68)STUB_OP_0F(69)STUB_OP_0F(6A)STUB_OP_0F(6B)STUB_OP_0F(6C)STUB_OP_0F(6D)STUB_OP_0F(6E)STUB_OP_0F(6F)
 STUB_OP_0F(70)STUB_OP_0F(71)STUB_OP_0F(72)STUB_OP_0F(73)STUB_OP_0F(74)STUB_OP_0F(75)STUB_OP_0F(76)STUB_OP_0F(77)
 STUB_OP_0F(78)STUB_OP_0F(79)STUB_OP_0F(7A)STUB_OP_0F(7B)STUB_OP_0F(7C)STUB_OP_0F(7D)STUB_OP_0F(7E)STUB_OP_0F(7F)
-STUB_OP_0F(80)STUB_OP_0F(81)STUB_OP_0F(82)STUB_OP_0F(83)STUB_OP_0F(84)STUB_OP_0F(85)STUB_OP_0F(86)STUB_OP_0F(87)
-STUB_OP_0F(88)STUB_OP_0F(89)STUB_OP_0F(8A)STUB_OP_0F(8B)STUB_OP_0F(8C)STUB_OP_0F(8D)STUB_OP_0F(8E)STUB_OP_0F(8F)
-STUB_OP_0F(90)STUB_OP_0F(91)STUB_OP_0F(92)STUB_OP_0F(93)STUB_OP_0F(94)STUB_OP_0F(95)STUB_OP_0F(96)STUB_OP_0F(97)
-STUB_OP_0F(98)STUB_OP_0F(99)STUB_OP_0F(9A)STUB_OP_0F(9B)STUB_OP_0F(9C)STUB_OP_0F(9D)STUB_OP_0F(9E)STUB_OP_0F(9F)
 STUB_OP_0F(A0)STUB_OP_0F(A1)STUB_OP_0F(A2)STUB_OP_0F(A3)STUB_OP_0F(A4)STUB_OP_0F(A5)STUB_OP_0F(A6)STUB_OP_0F(A7)
 STUB_OP_0F(A8)STUB_OP_0F(A9)STUB_OP_0F(AA)STUB_OP_0F(AB)STUB_OP_0F(AC)STUB_OP_0F(AD)STUB_OP_0F(AE)STUB_OP_0F(AF)
 STUB_OP_0F(B0)STUB_OP_0F(B1)STUB_OP_0F(B2)STUB_OP_0F(B3)STUB_OP_0F(B4)STUB_OP_0F(B5)STUB_OP_0F(B6)STUB_OP_0F(B7)
@@ -30,7 +30,8 @@ bool OP_C1_3(CPU *cpu, ModRM *modrm) {
 bool OP_C1_4(CPU *cpu, ModRM *modrm) {
     u32 disp;
     u64 ptr = cpu->getModRMPtr(modrm, disp);
-    Reg *dst = (modrm->_mod == 3) ? cpu->toReg(modrm->rm) : new Reg(ptr);
+    Reg mem = Reg();
+    Reg *dst = cpu->getRMReg(modrm, ptr, mem);
     u8 sft = cpu->getVal8();
     Reg src = Reg();
     src.l = sft;
@@ -40,7 +41,6 @@ bool OP_C1_4(CPU *cpu, ModRM *modrm) {
 
     if (modrm->_mod != 3) {
         cpu->writeReg(ptr, dst, modrm->reg_type);
-        delete dst;
     }
 
     return false;
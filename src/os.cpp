@@ -0,0 +1,194 @@
+#include "../inc/os.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <csignal>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace OS {
+
+// readable, writable and executable, nullptr when the host refuses
+u8 *allocExec(u64 size) {
+#ifdef _WIN32
+    return static_cast<u8 *>(VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE));
+#else
+    void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return (mem == MAP_FAILED) ? nullptr : static_cast<u8 *>(mem);
+#endif
+}
+
+namespace {
+
+// the ranges reserve() handed out, committed in CHUNK steps by the fault handler below.
+// slots are only ever added, before the guest runs, so the handler reads them without locking
+constexpr u64 CHUNK = 0x10000;
+constexpr int MAX_RANGES = 16;
+
+struct LazyRange {
+    u8 *base;
+    u64 size;
+};
+
+LazyRange lazy[MAX_RANGES];
+int lazy_count = 0;
+
+// the start of the chunk holding addr, nullptr when it is in none of the ranges
+u8 *chunkOf(const u8 *addr) {
+    for (int i = 0; i < lazy_count; i++) {
+        if (addr >= lazy[i].base && addr < lazy[i].base + lazy[i].size) {
+            return lazy[i].base + ((addr - lazy[i].base) & ~(CHUNK - 1));
+        }
+    }
+    return nullptr;
+}
+
+#ifdef _WIN32
+LONG CALLBACK commitOnTouch(EXCEPTION_POINTERS *info) {
+    if (info->ExceptionRecord->ExceptionCode != EXCEPTION_ACCESS_VIOLATION) return EXCEPTION_CONTINUE_SEARCH;
+
+    u8 *chunk = chunkOf(reinterpret_cast<u8 *>(info->ExceptionRecord->ExceptionInformation[1]));
+    if (!chunk) return EXCEPTION_CONTINUE_SEARCH;
+
+    return VirtualAlloc(chunk, CHUNK, MEM_COMMIT, PAGE_READWRITE) ? EXCEPTION_CONTINUE_EXECUTION : EXCEPTION_CONTINUE_SEARCH;
+}
+#else
+// anything outside the ranges, or a chunk the host will not commit, faults again with the default action
+void commitOnTouch(int sig, siginfo_t *info, void *) {
+    u8 *chunk = chunkOf(static_cast<u8 *>(info->si_addr));
+    if (chunk && mprotect(chunk, CHUNK, PROT_READ | PROT_WRITE) == 0) return;
+
+    signal(sig, SIG_DFL);
+}
+#endif
+
+} // namespace
+
+// address space for guest memory, zero filled and only committed where it is touched. a plain
+// MAP_NORESERVE mapping would still be charged in full on hosts with strict overcommit, so it starts
+// out inaccessible and the first access to each chunk makes it writable. up to MAX_RANGES per process
+u8 *reserve(u64 size) {
+    if (lazy_count == MAX_RANGES) return nullptr;
+    size = (size + CHUNK - 1) & ~(CHUNK - 1);
+
+#ifdef _WIN32
+    void *mem = VirtualAlloc(nullptr, size, MEM_RESERVE, PAGE_NOACCESS);
+    if (!mem) return nullptr;
+
+    if (!lazy_count) AddVectoredExceptionHandler(1, commitOnTouch);
+#else
+    void *mem = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mem == MAP_FAILED) return nullptr;
+
+    if (!lazy_count) {
+        struct sigaction act = {};
+        act.sa_sigaction = commitOnTouch;
+        act.sa_flags = SA_SIGINFO;
+        sigemptyset(&act.sa_mask);
+        sigaction(SIGSEGV, &act, nullptr);
+        sigaction(SIGBUS, &act, nullptr);
+    }
+#endif
+
+    lazy[lazy_count++] = { static_cast<u8 *>(mem), size };
+    return static_cast<u8 *>(mem);
+}
+
+// makes part of a range from reserve() usable up front, for what the host writes into it itself:
+// a read() into memory that is still inaccessible fails instead of faulting
+bool commit(u8 *at, u64 size) {
+    u8 *first = chunkOf(at);
+    if (!first) return false;
+    u64 len = (at + size - first + CHUNK - 1) & ~(CHUNK - 1);
+
+#ifdef _WIN32
+    return VirtualAlloc(first, len, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+    return mprotect(first, len, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+// puts the first size bytes of the file at at, inside a range from reserve(), without copying them.
+// pages stay shared with the page cache until written, a write gives that chunk a private copy.
+// false when that cannot be done: at or size not page aligned, a short file, or a host without it
+bool mapFileAt(const char *path, u8 *at, u64 size) {
+#ifdef _WIN32
+    return false;  // a view cannot go into reserved space without placeholder support
+#else
+    long page = sysconf(_SC_PAGESIZE);
+    if (!size || (reinterpret_cast<u64>(at) | size) & (page - 1)) return false;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    void *mem = (fstat(fd, &st) == 0 && static_cast<u64>(st.st_size) >= size)
+        ? mmap(at, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) : MAP_FAILED;
+    close(fd);
+
+    return mem != MAP_FAILED;
+#endif
+}
+
+void *openLibrary(const char *path) {
+#ifdef _WIN32
+    return reinterpret_cast<void *>(LoadLibraryA(path));
+#else
+    return dlopen(path, RTLD_NOW | RTLD_LOCAL);
+#endif
+}
+
+void *findSymbol(void *lib, const char *name) {
+#ifdef _WIN32
+    return reinterpret_cast<void *>(GetProcAddress(static_cast<HMODULE>(lib), name));
+#else
+    return dlsym(lib, name);
+#endif
+}
+
+// the whole file read only, nullptr if it is missing or empty
+const u8 *mapFile(const char *path, u64 *size) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return nullptr;
+
+    LARGE_INTEGER len;
+    HANDLE map = (GetFileSizeEx(file, &len) && len.QuadPart) ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    CloseHandle(file);
+    if (!map) return nullptr;
+
+    void *data = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(map);
+
+    *size = len.QuadPart;
+    return static_cast<const u8 *>(data);
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return nullptr;
+
+    struct stat st;
+    void *data = (fstat(fd, &st) == 0 && st.st_size) ? mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (data == MAP_FAILED) return nullptr;
+
+    *size = st.st_size;
+    return static_cast<const u8 *>(data);
+#endif
+}
+
+void unmapFile(const u8 *data, u64 size) {
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+#else
+    munmap(const_cast<u8 *>(data), size);
+#endif
+}
+
+} // namespace OS
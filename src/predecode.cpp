@@ -0,0 +1,94 @@
+#include "../inc/predecode.hpp"
+#include "../inc/ram.hpp"
+#include "../inc/x64.hpp"
+#include <deque>
+#include <unordered_set>
+
+// the walk gets a CPU of its own, decoding writes to the CPU it runs on
+Predecoder::Predecoder(u64 base, u16 ip) : slots(new Slot[SIZE]) {
+    this->worker = std::thread([this, base, ip] {
+        std::unique_ptr<CPU> scratch = std::make_unique<CPU>();
+        scratch->predecode(this, base, ip);
+    });
+}
+
+Predecoder::~Predecoder() {
+    this->stop.store(true, std::memory_order_relaxed);
+    this->worker.join();
+}
+
+const IndexInst *Predecoder::find(u64 addr) const {
+    for (u32 i = 0; i < PROBES; i++) {
+        const Slot &slot = this->slots[(index(addr) + i) & (SIZE - 1)];
+        u64 at = slot.addr.load(std::memory_order_acquire);
+
+        if (at == addr) return &slot.inst;
+        if (at == ~0ULL) return nullptr;
+    }
+    return nullptr;
+}
+
+// only the decoding thread calls this. false once the table is too full to take more
+bool Predecoder::publish(const IndexInst &inst) {
+    for (u32 i = 0; i < PROBES; i++) {
+        Slot &slot = this->slots[(index(inst.inst.addr) + i) & (SIZE - 1)];
+        u64 at = slot.addr.load(std::memory_order_relaxed);
+
+        if (at == inst.inst.addr) return true;
+        if (at == ~0ULL) {
+            slot.inst = inst;
+            slot.addr.store(inst.inst.addr, std::memory_order_release);
+            return true;
+        }
+    }
+    return false;
+}
+
+// runs on the Predecoder's thread, breadth first from base:ip through every target decodeRun() and
+// runExits() know of, staying inside the ROM
+void CPU::predecode(Predecoder *into, u64 base, u16 ip) {
+    std::deque<u16> work { ip };
+    std::unordered_set<u16> seen;
+    IndexInst packed;
+
+    while (!work.empty() && !into->stopping()) {
+        u16 at = work.front();
+        work.pop_front();
+
+        u64 addr = base + at;
+        if (!RAM::inROM(addr, 1) || !seen.insert(at).second) continue;
+
+        DecodedInst run[MAX_BLOCK];
+        int count = this->decodeRun(addr, run);
+
+        for (int i = 0; i < count; i++) {
+            if (run[i].len > sizeof(run[i].bytes) || !RAM::inROM(run[i].addr, run[i].len)) continue;
+            if (!this->packInst(run[i], packed)) continue;
+            if (!into->publish(packed)) return;
+        }
+
+        // targets wrap around the 64 KiB segment like IP does
+        u16 end = at + (run[count - 1].addr + run[count - 1].len - addr);
+        s64 exits[2];
+        int n = runExits<MODE_REAL>(run[count - 1], exits);
+        for (int i = 0; i < n; i++) {
+            work.push_back(end + exits[i]);
+        }
+    }
+}
+
+// what the Predecoder has for addr, checked against the bytes there now since the guest may have
+// written them after they were decoded. leaves it in inst
+bool CPU::takePredecoded(u64 addr) {
+    if (!this->predecoder || this->mode != MODE_REAL) return false;
+
+    // host pointers only last to the page end, and a device or hole may sit over part of the image
+    const IndexInst *found = this->predecoder->find(addr);
+    if (!found || !RAM::hostPtr(addr) || !RAM::hostPtr(addr + found->inst.len - 1)) return false;
+    for (u32 i = 0; i < found->inst.len; i++) {
+        if (found->inst.bytes[i] != RAM::read(addr + i)) return false;
+    }
+
+    this->inst = this->unpackInst(*found);
+    return true;
+}
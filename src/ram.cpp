@@ -1,43 +1,197 @@
+#include "../inc/mmio.hpp"
+#include "../inc/os.hpp"
 #include "../inc/ram.hpp"
+#include <algorithm>
 #include <cstdlib>
+#include <deque>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 
 namespace RAM {
 
-u8 *data;
+std::vector<Region> regions;
+thread_local LastHit last;
+u64 rom_size;
+u64 rom_hash;
+const u8 *rom_image;
 
-void load(const char *filename) {
-    std::ifstream rom(filename);
-    if (!rom) {
-        return;
+namespace {
+
+static constexpr u64 TABLE_PAGES = 1ULL << PageTable::BITS;
+static constexpr u64 DIR_TABLES  = 1ULL << PageDir::BITS;
+
+// host memory behind each region, in the order they were declared. MMIO pages point at the region
+// in here, so it must not move
+struct Backing {
+    Region region;
+    u8 *host;
+};
+
+std::deque<Backing> backing;
+std::atomic<PageDir *> root[1 << ROOT_BITS];
+PageTable holes;  // shared by every table no region reaches into
+std::mutex building;  // the predecoder thread looks pages up too
+
+// writes what b says about the pages it shares with the table for the TABLE_PAGES pages from page number first
+void apply(PageTable *table, u64 first, const Backing &b) {
+    u64 lo = std::max(b.region.base >> PAGE_BITS, first);
+    u64 hi = std::min((b.region.base + b.region.size) >> PAGE_BITS, first + TABLE_PAGES);
+
+    for (u64 n = lo; n < hi; n++) {
+        Page &p = table->pages[n - first];
+        p.host = b.host ? b.host + ((n << PAGE_BITS) - b.region.base) : nullptr;
+        p.mmio = (b.region.kind == Kind::MMIO) ? &b.region : nullptr;
+        p.kind = b.region.kind;
     }
+}
+
+bool overlaps(const Region &region, u64 first) {
+    return region.base >> PAGE_BITS < first + TABLE_PAGES && (region.base + region.size) >> PAGE_BITS > first;
+}
 
-    data = (u8 *)malloc(0x100000000 * sizeof(u8));
-    if (!data) {
-        rom.close();
-        return;
+// the table for the TABLE_PAGES pages from page number first, the last region declared wins
+PageTable *build(u64 first) {
+    PageTable *table = nullptr;
+
+    for (const Backing &b : backing) {
+        if (!overlaps(b.region, first)) continue;
+
+        if (!table) table = new PageTable();
+        apply(table, first, b);
+    }
+
+    return table ? table : &holes;
+}
+
+// whole pages, within the physical address width
+Region pageAligned(Region region) {
+    u64 end = (region.base + region.size + PAGE - 1) & ~(PAGE - 1);
+    region.base = (region.base & PHYS_MASK) & ~(PAGE - 1);
+    region.size = std::min(end, PHYS_MASK + 1) - region.base;
+    return region;
+}
+
+} // namespace
+
+// a walk of the directory, building whatever part of it is missing. fills the LastHit
+Page *lookup(u64 addr) {
+    u64 n = (addr & PHYS_MASK) >> PAGE_BITS;
+    u64 r = n >> (PageDir::BITS + PageTable::BITS);
+    u64 d = (n >> PageTable::BITS) & (DIR_TABLES - 1);
+
+    PageDir *dir = root[r].load(std::memory_order_acquire);
+    PageTable *table = dir ? dir->tables[d].load(std::memory_order_acquire) : nullptr;
+
+    if (!table) {
+        std::lock_guard<std::mutex> lock(building);
+
+        dir = root[r].load(std::memory_order_relaxed);
+        if (!dir) {
+            dir = new PageDir();
+            root[r].store(dir, std::memory_order_release);
+        }
+
+        table = dir->tables[d].load(std::memory_order_relaxed);
+        if (!table) {
+            table = build(n & ~(TABLE_PAGES - 1));
+            dir->tables[d].store(table, std::memory_order_release);
+        }
+    }
+
+    last = { n, &table->pages[n & (TABLE_PAGES - 1)] };
+    return last.entry;
+}
+
+// what every PC has: RAM from 0 up to the firmware image at the top of 4 GiB, and nothing above
+std::vector<Region> defaultLayout(u64 rom_size) {
+    u64 rom_base = (TOP_4G - rom_size) & ~(PAGE - 1);
+    return { { 0, rom_base, Kind::RAM }, { rom_base, TOP_4G - rom_base, Kind::ROM } };
+}
+
+// each region is reserved, not allocated, and committed as the guest touches it. the image goes at the
+// top of the ROM region straight from the file when it is a whole number of pages, and is copied in otherwise.
+// extra regions come after the default layout, so they can also cover parts of it
+bool load(const char *filename, const std::vector<Region> &extra) {
+    std::ifstream rom(filename, std::ios::binary);
+    if (!rom) {
+        return false;
     }
 
     rom.seekg(0, std::ios::end);
     size_t size = rom.tellg();
     rom.seekg(0, std::ios::beg);
-    
+
     std::cout << "File Size: 0x" << std::hex << (int)size << std::endl;
+    rom_size = size;
+
+    regions = defaultLayout(size);
+    regions.insert(regions.end(), extra.begin(), extra.end());
+
+    for (Region &region : regions) {
+        region = pageAligned(region);
+
+        u8 *host = (region.kind <= Kind::ROM) ? OS::reserve(region.size) : nullptr;
+        if (!host && region.kind <= Kind::ROM) {
+            return false;
+        }
+        backing.push_back({ region, host });
+    }
 
-    if (rom.read(reinterpret_cast<char *>(data + 0x100000000 - size), size)) {
-        return;
+    const Backing &image = backing[1];
+    u8 *top = image.host + image.region.size - size;
+
+    bool loaded = OS::mapFileAt(filename, top, size);
+    if (!loaded && OS::commit(top, size)) {
+        loaded = static_cast<bool>(rom.read(reinterpret_cast<char *>(top), size));
+    }
+    if (loaded) {
+        rom_image = top;
+        rom_hash = hash(top, size);
     }
+    return loaded;
+}
+
+// puts a device over part of the address space once memory is set up, patching the tables already
+// built there. meant for machine setup: a thread that looked one of the pages up before keeps what it saw
+void attach(u64 base, u64 size, MmioDevice *device) {
+    std::lock_guard<std::mutex> lock(building);
+
+    Region region = pageAligned({ base, size, Kind::MMIO, device });
+    regions.push_back(region);
+    backing.push_back({ region, nullptr });
+
+    u64 end = (region.base + region.size) >> PAGE_BITS;
+    for (u64 first = (region.base >> PAGE_BITS) & ~(TABLE_PAGES - 1); first < end; first += TABLE_PAGES) {
+        PageDir *dir = root[first >> (PageDir::BITS + PageTable::BITS)].load(std::memory_order_relaxed);
+        std::atomic<PageTable *> *slot = dir ? &dir->tables[(first >> PageTable::BITS) & (DIR_TABLES - 1)] : nullptr;
 
-    rom.close();
+        PageTable *table = slot ? slot->load(std::memory_order_relaxed) : nullptr;
+        if (!table) continue;  // built with the device in it when first looked at
+
+        if (table == &holes) {
+            table = new PageTable();
+            slot->store(table, std::memory_order_release);
+        }
+        apply(table, first, backing.back());
+    }
+
+    last = LastHit();
 }
 
-u8 read(u64 addr) {
-    return data[addr & 0xFFFFFFFF];
+// reads of MMIO and holes
+u64 readSlow(const Page *p, u64 addr, u32 width) {
+    if (p->kind == Kind::MMIO) {
+        return p->mmio->device->read((addr & PHYS_MASK) - p->mmio->base, width);
+    }
+    return ~0ULL >> (64 - width * 8);
 }
 
-void write(u64 addr, u8 val) {
-    data[addr & 0xFFFFFFFF] = val;
+// writes to anything but RAM, only devices see them
+void writeSlow(const Page *p, u64 addr, u64 val, u32 width) {
+    if (p->kind == Kind::MMIO) {
+        p->mmio->device->write((addr & PHYS_MASK) - p->mmio->base, val, width);
+    }
 }
 
-} // namespace RAM
\ No newline at end of file
+} // namespace RAM
@@ -0,0 +1,713 @@
+#include "../inc/alu.hpp"
+#include "../inc/aot.hpp"
+#include "../inc/jit.hpp"
+#include "../inc/ram.hpp"
+#include "../inc/uop.hpp"
+#include "../inc/x64.hpp"
+#include <algorithm>
+#include <iostream>
+
+bool IRCache::current(const IRBlock *block, u64 addr, CPUMode mode) {
+    if (block->addr != addr || block->mode != mode) return false;
+    if (block->gen[0] != RAM::pageGen(addr)) return false;
+    if (block->gen[1] != RAM::pageGen(addr + block->len - 1)) return false;
+
+    return true;
+}
+
+IRBlock *IRCache::lookup(u64 addr, CPUMode mode) {
+    IRBlock *block = &this->entries[index(addr)];
+    return current(block, addr, mode) ? block : nullptr;
+}
+
+// the block whose links lead to addr after from ran. that is from itself, except after a RET
+// that went back where the matching CALL would return to, then it is the block of that CALL
+IRBlock *IRCache::linkOwner(IRBlock *from, u64 addr) {
+    switch (from->exit) {
+        default: return from;
+
+        case BlockExit::CALL:
+            this->rets.push(from);
+            return from;
+
+        case BlockExit::RET: {
+            BlockLink call = this->rets.pop();
+            bool hit = call.block && call.block->version == call.version && call.block->end() == addr;
+            return hit ? call.block : from;
+        }
+    }
+}
+
+IRBlock *IRCache::follow(IRBlock *owner, u64 addr, CPUMode mode) {
+    for (const BlockLink &link : owner->next) {
+        if (link.block && link.block->version == link.version && current(link.block, addr, mode)) {
+            return link.block;
+        }
+    }
+    return nullptr;
+}
+
+void IRCache::link(IRBlock *owner, IRBlock *to) {
+    owner->next[(to->addr == owner->end()) ? 0 : 1] = { to, to->version };
+}
+
+template <AluOp Op, typename T, bool F>
+static u64 uopAlu(CPU *cpu, u64 a, u64 b) {
+    if constexpr (Op == AluOp::ADD) return add <T, F>(cpu, a, b);
+    if constexpr (Op == AluOp::ADC) return adc <T, F>(cpu, a, b);
+    if constexpr (Op == AluOp::SUB) return sub <T, F>(cpu, a, b);
+    if constexpr (Op == AluOp::AND) return andF<T, F>(cpu, a, b);
+    if constexpr (Op == AluOp::XOR) return xorF<T, F>(cpu, a, b);
+}
+
+template <AluOp Op>
+static UopAluFunc pickUopAlu(int width, bool flags) {
+    static constexpr UopAluFunc table[4][2] = {
+        { uopAlu<Op, u8,  false>, uopAlu<Op, u8,  true> },
+        { uopAlu<Op, u16, false>, uopAlu<Op, u16, true> },
+        { uopAlu<Op, u32, false>, uopAlu<Op, u32, true> },
+        { uopAlu<Op, u64, false>, uopAlu<Op, u64, true> },
+    };
+    return table[width][flags];
+}
+
+UopAluFunc getUopAlu(AluOp op, RegType type, bool flags) {
+    int width = (type == RegType::R16) ? 1 : (type == RegType::R32) ? 2 : (type == RegType::R64) ? 3 : 0;
+
+    switch (op) {
+        default:
+        case AluOp::ADD: return pickUopAlu<AluOp::ADD>(width, flags);
+        case AluOp::ADC: return pickUopAlu<AluOp::ADC>(width, flags);
+        case AluOp::SUB: return pickUopAlu<AluOp::SUB>(width, flags);
+        case AluOp::AND: return pickUopAlu<AluOp::AND>(width, flags);
+        case AluOp::XOR: return pickUopAlu<AluOp::XOR>(width, flags);
+    }
+}
+
+static inline u64 readAs(const Reg &reg, RegType type) {
+    switch (type) {
+        case RegType::R8:  return reg.l;
+        case RegType::R8H: return reg.h;
+        case RegType::R16: return reg.x;
+        case RegType::R32: return reg.e;
+        default:           return reg.r;
+    }
+}
+
+static inline void writeAs(Reg &reg, RegType type, u64 val) {
+    switch (type) {
+        case RegType::R8:  reg.l = val; break;
+        case RegType::R8H: reg.h = val; break;
+        case RegType::R16: reg.x = val; break;
+        case RegType::R32: reg.r = static_cast<u32>(val); break;
+        default:           reg.r = val; break;
+    }
+}
+
+namespace {
+
+// operand of a lowered instruction, a register or memory at the address held in temp addr
+struct UopOperand {
+    bool mem;
+    u8 reg;
+    RegType type;
+    u8 addr;
+};
+
+struct UopBuilder {
+    IRBlock *block;
+    u8 temps = 0;
+
+    Uop &emit(UopKind kind) {
+        this->block->uops.emplace_back();
+        this->block->uops.back().kind = kind;
+        return this->block->uops.back();
+    }
+
+    u8 constant(u64 val) {
+        Uop &u = this->emit(UopKind::CONST);
+        u.dst = this->temps++;
+        u.imm = val;
+        return u.dst;
+    }
+
+    u8 ea(u16 inst) {
+        Uop &u = this->emit(UopKind::EA);
+        u.dst = this->temps++;
+        u.inst = inst;
+        return u.dst;
+    }
+
+    u8 read(const UopOperand &op) {
+        Uop &u = this->emit(op.mem ? UopKind::LOAD : UopKind::GETREG);
+        u.dst  = this->temps++;
+        u.type = op.type;
+        u.reg  = op.reg;
+        u.a    = op.addr;
+        return u.dst;
+    }
+
+    void write(const UopOperand &op, u8 val) {
+        Uop &u = this->emit(op.mem ? UopKind::STORE : UopKind::SETREG);
+        u.type = op.type;
+        u.reg  = op.reg;
+        u.a    = op.mem ? op.addr : val;
+        u.b    = val;
+    }
+
+    u8 alu(AluOp op, RegType type, u8 a, u8 b, bool flags) {
+        Uop &u = this->emit(UopKind::ALU);
+        u.dst   = this->temps++;
+        u.op    = op;
+        u.type  = type;
+        u.a     = a;
+        u.b     = b;
+        u.flags = flags;
+        u.alu   = getUopAlu(op, type, flags);
+        return u.dst;
+    }
+};
+
+} // namespace
+
+// AH..BH when there is no REX prefix, the decoder already moved the reg field of those down by 4
+static UopOperand byteReg(const DecodedInst &inst, u8 raw, u8 rex) {
+    if (!inst.pfx.has_rex && raw >= 4) {
+        return { false, static_cast<u8>(raw - 4), RegType::R8H, 0 };
+    }
+    return { false, static_cast<u8>(rex | raw), RegType::R8, 0 };
+}
+
+static UopOperand regOperand(const DecodedInst &inst, bool byte) {
+    const ModRM &modrm = inst.modrm;
+
+    if (byte) {
+        return byteReg(inst, modrm._reg + ((modrm.reg_type == RegType::R8H) ? 4 : 0), inst.pfx.rexR());
+    }
+    return { false, static_cast<u8>(inst.pfx.rexR() | modrm._reg), modrm.reg_type, 0 };
+}
+
+static UopOperand rmOperand(UopBuilder &b, const DecodedInst &inst, u16 idx, bool byte) {
+    const ModRM &modrm = inst.modrm;
+
+    if (modrm._mod == 3) {
+        if (byte) return byteReg(inst, modrm._rm, inst.pfx.rexB());
+        return { false, static_cast<u8>(inst.pfx.rexB() | modrm._rm), modrm.reg_type, 0 };
+    }
+    return { true, 0, byte ? RegType::R8 : modrm.reg_type, b.ea(idx) };
+}
+
+// ADD, ADC and CMP rows of the one byte map plus the SUB and XOR forms the handler tables have,
+// which only act in real mode. everything else there is still a stub and has to keep halting through CALL
+template <CPUMode M>
+static bool aluForm(u16 op, AluOp &alu) {
+    switch (op >> 3) {
+        default: return false;
+
+        case 0: alu = AluOp::ADD; return true;
+        case 2: alu = AluOp::ADC; return true;
+        case 5: alu = AluOp::SUB; return M == MODE_REAL && op == 0x29;
+        case 6: alu = AluOp::XOR; return M == MODE_REAL && op == 0x31;
+        case 7: alu = AluOp::SUB; return true;  // CMP
+    }
+}
+
+// Iz/Iv immediate widened to the operand size
+static u64 immOf(const DecodedInst &inst, RegType type) {
+    switch (type) {
+        case RegType::R8:  return inst.imm & 0xFF;
+        case RegType::R16: return inst.imm & 0xFFFF;
+        case RegType::R64: return static_cast<s64>(static_cast<s32>(inst.imm));
+        default:           return inst.imm & 0xFFFFFFFF;
+    }
+}
+
+// emits the uops for one instruction, false leaves it to a CALL of its handler
+template <CPUMode M>
+static bool lowerInst(UopBuilder &b, const DecodedInst &inst, u16 idx) {
+    u16 op = inst.opcode;
+    bool flags = inst.flags_live != 0;
+    RegType opsize = CPU::opSizeOf<M>(inst.pfx);
+    AluOp alu;
+
+    if (inst.fuse == FUSE_ZERO && M == MODE_REAL && (op == 0x29 || op == 0x31)) {
+        b.write(rmOperand(b, inst, idx, false), b.constant(0));
+        if (flags) b.emit(UopKind::ZEROFLAGS);
+        return true;
+    }
+
+    if (inst.fuse == FUSE_MOV_IMM) {
+        b.write({ false, static_cast<u8>(op & 7), opsize, 0 }, b.constant(inst.imm));
+        b.write({ false, inst.fuse_op, opsize, 0 }, b.constant(inst.fuse_imm));
+        return true;
+    }
+
+    if (op < 0x40 && (op & 7) < 6 && aluForm<M>(op, alu)) {
+        bool write = (op >> 3) != 7;
+        bool byte  = !(op & 1);
+
+        if ((op & 7) < 4) {
+            UopOperand reg = regOperand(inst, byte);
+            UopOperand rm  = rmOperand(b, inst, idx, byte);
+            UopOperand &dst = (op & 2) ? reg : rm;
+            UopOperand &src = (op & 2) ? rm  : reg;
+
+            u8 res = b.alu(alu, dst.type, b.read(dst), b.read(src), flags);
+            if (write) b.write(dst, res);
+        } else {
+            UopOperand acc = { false, 0, byte ? RegType::R8 : opsize, 0 };
+
+            u8 res = b.alu(alu, acc.type, b.read(acc), b.constant(immOf(inst, acc.type)), flags);
+            if (write) b.write(acc, res);
+        }
+    } else {
+        switch (op) {
+            default: return false;
+
+            case 0x84: case 0x85: {  // TEST Eb,Gb Ev,Gv
+                bool byte = !(op & 1);
+                UopOperand rm  = rmOperand(b, inst, idx, byte);
+                UopOperand reg = regOperand(inst, byte);
+
+                b.alu(AluOp::AND, rm.type, b.read(rm), b.read(reg), flags);
+                break;
+            }
+
+            case 0xA8: case 0xA9: {  // TEST AL,Ib eAX,Iz
+                UopOperand acc = { false, 0, (op & 1) ? opsize : RegType::R8, 0 };
+
+                b.alu(AluOp::AND, acc.type, b.read(acc), b.constant(immOf(inst, acc.type)), flags);
+                break;
+            }
+
+            case 0x89: {  // MOV Ev,Gv, OP_89 only acts in real mode
+                if (M != MODE_REAL) return false;
+
+                UopOperand reg = regOperand(inst, false);
+                UopOperand rm  = rmOperand(b, inst, idx, false);
+
+                b.write(rm, b.read(reg));
+                break;
+            }
+
+            case 0xB8: case 0xB9: case 0xBA: case 0xBB: case 0xBC: case 0xBD: case 0xBE: case 0xBF:
+                b.write({ false, static_cast<u8>(inst.pfx.rexB() | (op & 7)), opsize, 0 }, b.constant(inst.imm));
+                break;
+
+            case 0x70: case 0x71: case 0x72: case 0x73: case 0x74: case 0x75: case 0x76: case 0x77:
+            case 0x78: case 0x79: case 0x7A: case 0x7B: case 0x7C: case 0x7D: case 0x7E: case 0x7F: {
+                Uop &u = b.emit(UopKind::BRANCH);
+                u.cc  = op & 0xF;
+                u.imm = static_cast<s8>(inst.imm);
+                return true;
+            }
+
+            case 0x0F80: case 0x0F81: case 0x0F82: case 0x0F83: case 0x0F84: case 0x0F85: case 0x0F86: case 0x0F87:
+            case 0x0F88: case 0x0F89: case 0x0F8A: case 0x0F8B: case 0x0F8C: case 0x0F8D: case 0x0F8E: case 0x0F8F: {
+                Uop &u = b.emit(UopKind::BRANCH);
+                u.cc  = op & 0xF;
+                u.imm = (opsize == RegType::R16) ? static_cast<s16>(inst.imm) : static_cast<s32>(inst.imm);
+                return true;
+            }
+
+            case 0xE9:  // so does OP_E9
+                if (M != MODE_REAL) return false;
+
+                b.emit(UopKind::JUMP).imm = (opsize == RegType::R16) ? static_cast<s16>(inst.imm) : static_cast<s32>(inst.imm);
+                return true;
+        }
+    }
+
+    if (inst.fuse == FUSE_CMP_JCC) {
+        Uop &u = b.emit(UopKind::BRANCH);
+        u.cc  = inst.fuse_op;
+        u.imm = inst.fuse_imm;
+    }
+    return true;
+}
+
+// lowers and optimizes the block at addr, from instructions decoded earlier when known holds them
+template <CPUMode M>
+void CPU::translateBlock(u64 addr, IRBlock *block, const DecodedInst *known, int known_count) {
+    DecodedInst run[MAX_BLOCK];
+    int count = known_count;
+
+    if (known) {
+        std::copy(known, known + count, run);
+    } else {
+        count = this->decodeRun(addr, run);
+    }
+
+    block->addr = addr;
+    block->mode = M;
+    block->len  = run[count - 1].addr + run[count - 1].len - addr;
+    block->gen[0] = RAM::pageGen(addr);
+    block->gen[1] = RAM::pageGen(addr + block->len - 1);
+    block->insts.assign(run, run + count);
+    block->uops.clear();
+    block->runs = 0;
+    block->code = nullptr;
+    block->aot  = nullptr;
+    block->version++;
+    block->next[0] = block->next[1] = BlockLink();
+
+    switch (run[count - 1].opcode) {
+        default:   block->exit = BlockExit::PLAIN; break;
+        case 0xE8: block->exit = BlockExit::CALL; break;
+        case 0xC3: block->exit = BlockExit::RET; break;
+    }
+
+    UopBuilder b { block };
+
+    for (u16 i = 0; i < count; i++) {
+        const DecodedInst &inst = block->insts[i];
+
+        b.emit(UopKind::ADVANCE).imm = inst.len;
+
+        if (!inst.valid || !lowerInst<M>(b, inst, i)) {
+            b.emit(UopKind::CALL).inst = i;
+        }
+    }
+
+    optimizeBlock(block);
+#ifdef ACCUI64_AOT
+    if (this->aot) block->aot = this->aot->find(block);
+#endif
+}
+
+// an earlier register write is dead if a later one replaces every byte of it
+static bool regWriteCovers(RegType later, RegType earlier) {
+    switch (later) {
+        case RegType::R64: case RegType::R32: return true;  // 32 bit writes zero the top half
+        case RegType::R16: return earlier == RegType::R16 || earlier == RegType::R8 || earlier == RegType::R8H;
+        default:           return later == earlier;
+    }
+}
+
+// forward pass: forwards register values, reuses effective addresses and folds constants.
+// backward pass: drops uops whose result nobody reads and register writes a later one replaces.
+// memory is left alone, an address may turn out to be a device, or ROM that drops the store, so
+// every LOAD and STORE stays and runs in order
+void optimizeBlock(IRBlock *block) {
+    constexpr int TEMPS = IRBlock::MAX_TEMPS;
+    constexpr u8 NONE = 0xFF;
+
+    std::vector<Uop> &uops = block->uops;
+
+    u8 alias[TEMPS];
+    bool known[TEMPS] = {};
+    u64 value[TEMPS];
+    for (int i = 0; i < TEMPS; i++) alias[i] = i;
+
+    struct RegVal { u8 temp; RegType type; };
+    RegVal regval[17];
+    std::vector<const Uop *> eas;
+
+    auto forget = [&]() {
+        for (RegVal &r : regval) r.temp = NONE;
+        eas.clear();
+    };
+    forget();
+
+    for (Uop &u : uops) {
+        u.a = alias[u.a];
+        u.b = alias[u.b];
+
+        switch (u.kind) {
+            default: break;
+
+            case UopKind::CONST:
+                known[u.dst] = true;
+                value[u.dst] = u.imm;
+                break;
+
+            case UopKind::GETREG:
+                if (regval[u.reg].temp != NONE && regval[u.reg].type == u.type) {
+                    alias[u.dst] = regval[u.reg].temp;
+                    u.kind = UopKind::NOP;
+                } else {
+                    regval[u.reg] = { u.dst, u.type };
+                }
+                break;
+
+            case UopKind::SETREG:
+                regval[u.reg] = { u.a, u.type };
+                eas.clear();
+                break;
+
+            case UopKind::EA: {
+                const DecodedInst &inst = block->insts[u.inst];
+                bool rip = inst.ea == eaRip<u32> || inst.ea == eaRip<u64>;
+
+                for (const Uop *prev : eas) {
+                    const DecodedInst &other = block->insts[prev->inst];
+
+                    if (!rip && other.ea == inst.ea && other.ea_base == inst.ea_base && other.ea_idx == inst.ea_idx &&
+                        other.ea_scale == inst.ea_scale && other.disp == inst.disp) {
+                        alias[u.dst] = prev->dst;
+                        u.kind = UopKind::NOP;
+                        break;
+                    }
+                }
+                if (u.kind == UopKind::EA) eas.push_back(&u);
+                break;
+            }
+
+            case UopKind::ALU:
+                if (!u.flags && u.op != AluOp::ADC && known[u.a] && known[u.b]) {
+                    u.imm  = u.alu(nullptr, value[u.a], value[u.b]);
+                    u.kind = UopKind::CONST;
+                    known[u.dst] = true;
+                    value[u.dst] = u.imm;
+                }
+                break;
+
+            case UopKind::CALL:
+                forget();
+                break;
+        }
+    }
+
+    bool used[TEMPS] = {};
+    RegType cover[17];
+    bool covered[17] = {};
+
+    for (int i = uops.size() - 1; i >= 0; i--) {
+        Uop &u = uops[i];
+
+        switch (u.kind) {
+            default: break;
+
+            case UopKind::CONST: case UopKind::GETREG: case UopKind::EA:
+                if (!used[u.dst]) u.kind = UopKind::NOP;
+                break;
+
+            case UopKind::ALU:
+                if (!used[u.dst] && !u.flags) u.kind = UopKind::NOP;
+                break;
+
+            case UopKind::SETREG:
+                if (covered[u.reg] && regWriteCovers(cover[u.reg], u.type)) u.kind = UopKind::NOP;
+                break;
+        }
+
+        switch (u.kind) {
+            default: break;
+
+            case UopKind::GETREG:
+                covered[u.reg] = false;
+                break;
+
+            case UopKind::SETREG:
+                used[u.a] = true;
+                if (!covered[u.reg] || !regWriteCovers(cover[u.reg], u.type)) {
+                    cover[u.reg] = u.type;
+                    covered[u.reg] = true;
+                }
+                break;
+
+            case UopKind::ALU:
+                used[u.a] = used[u.b] = true;
+                break;
+
+            case UopKind::LOAD: case UopKind::STORE:
+                used[u.a] = used[u.b] = true;
+                std::fill(std::begin(covered), std::end(covered), false);  // faults see every register
+                break;
+
+            case UopKind::EA: case UopKind::CALL: case UopKind::BRANCH: case UopKind::JUMP:
+                std::fill(std::begin(covered), std::end(covered), false);
+                break;
+        }
+    }
+
+    std::erase_if(uops, [](const Uop &u) { return u.kind == UopKind::NOP; });
+}
+
+template <CPUMode M>
+bool CPU::runIRBlock(const IRBlock *block) {
+    u64 t[IRBlock::MAX_TEMPS];
+
+    for (const Uop &u : block->uops) {
+        switch (u.kind) {
+            case UopKind::NOP: break;
+
+            case UopKind::CONST:  t[u.dst] = u.imm; break;
+            case UopKind::GETREG: t[u.dst] = readAs(this->regs[u.reg], u.type); break;
+            case UopKind::SETREG: writeAs(this->regs[u.reg], u.type, t[u.a]); break;
+            case UopKind::ALU:    t[u.dst] = u.alu(this, t[u.a], t[u.b]); break;
+
+            case UopKind::EA: {
+                const DecodedInst *inst = &block->insts[u.inst];
+                t[u.dst] = inst->ea(this, inst);
+                break;
+            }
+
+            case UopKind::LOAD:
+                this->checkExceptions<M, excMask<ExceptionType::SS, GP, PF, AC>>(t[u.a]);
+                t[u.dst] = this->readMem(t[u.a], u.type);
+                break;
+
+            case UopKind::STORE: {
+                this->checkExceptions<M, excMask<ExceptionType::SS, GP, PF, AC>>(t[u.a]);
+                Reg val = Reg();
+                val.r = t[u.b];
+                this->writeReg(t[u.a], &val, u.type);
+                break;
+            }
+
+            case UopKind::ZEROFLAGS:
+                this->zeroFlags();
+                break;
+
+            case UopKind::ADVANCE:
+                if constexpr (M == MODE_REAL) {
+                    IP->x += u.imm;
+                } else {
+                    IP->e += u.imm;
+                }
+                break;
+
+            case UopKind::BRANCH:
+                if (!this->testCond(u.cc)) return false;
+                [[fallthrough]];
+
+            case UopKind::JUMP:
+                if constexpr (M == MODE_REAL) {
+                    IP->x += u.imm;
+                } else {
+                    IP->e += u.imm;
+                }
+                return false;
+
+            case UopKind::CALL:
+                this->inst = block->insts[u.inst];
+                if (this->execute()) {
+                    if (u.inst > 0) this->traceStep(u.inst);  // the instructions before the halt still get their trace
+                    return true;
+                }
+                if (!this->running || this->mode != M) return false;
+                break;
+        }
+    }
+
+    return false;
+}
+
+template <CPUMode M>
+u32 nativeLoad(CPU *cpu, u64 addr, u64 type, u64 *out) {
+    try {
+        cpu->checkExceptions<M, excMask<ExceptionType::SS, GP, PF, AC>>(addr);
+        *out = cpu->readMem(addr, static_cast<RegType>(type));
+    } catch (const CPUFault &fault) {
+        cpu->ir_cache->fault = fault;
+        return NATIVE_FAULT;
+    }
+    return NATIVE_NEXT;
+}
+
+template <CPUMode M>
+u32 nativeStore(CPU *cpu, u64 addr, u64 val, u64 type) {
+    try {
+        cpu->checkExceptions<M, excMask<ExceptionType::SS, GP, PF, AC>>(addr);
+        Reg reg = Reg();
+        reg.r = val;
+        cpu->writeReg(addr, &reg, static_cast<RegType>(type));
+    } catch (const CPUFault &fault) {
+        cpu->ir_cache->fault = fault;
+        return NATIVE_FAULT;
+    }
+    return NATIVE_NEXT;
+}
+
+template <CPUMode M>
+u32 nativeCall(CPU *cpu, const DecodedInst *inst, u64 first) {
+    try {
+        cpu->inst = *inst;
+        if (cpu->execute()) return first ? NATIVE_HALT : NATIVE_DONE;
+    } catch (const CPUFault &fault) {
+        cpu->ir_cache->fault = fault;
+        return NATIVE_FAULT;
+    }
+    return (cpu->running && cpu->mode == M) ? NATIVE_NEXT : NATIVE_DONE;
+}
+
+u64 nativeAlu(CPU *cpu, u64 op, u64 type, u64 flags, u64 a, u64 b) {
+    return getUopAlu(static_cast<AluOp>(op), static_cast<RegType>(type), flags)(cpu, a, b);
+}
+
+u32 nativeCond(CPU *cpu, u64 cc) {
+    return cpu->testCond(cc);
+}
+
+void nativeZeroFlags(CPU *cpu) {
+    cpu->zeroFlags();
+}
+
+// translates each block once, then runs its uops until the mode changes. with ACCUI64_AOT
+// blocks the plugin has precompiled run that code, with ACCUI64_JIT blocks that ran Jit::HOT
+// times are compiled to host code, retranslation drops both again.
+// successors are found through block links first and the hashed cache only on a miss
+template <CPUMode M>
+void CPU::runIR() {
+    if (!this->ir_cache) {
+        this->ir_cache = new IRCache();
+    }
+#ifdef ACCUI64_JIT
+    if (!this->jit) {
+        this->jit = new Jit();
+    }
+#endif
+
+    IRBlock *prev = nullptr;
+
+    while (this->running && this->mode == M) {
+#ifdef ACCUI64_HLE
+        // hooked routines are entered by CALL, which ends a block, so they always start one
+        if (this->hle && this->hle->enter(this)) {
+            this->traceStep();
+            prev = nullptr;
+            continue;
+        }
+#endif
+        u64 addr = CS->base + IP->e;
+
+        // the previous block's links, or the return stack, usually know the next block already
+        IRBlock *owner = prev ? this->ir_cache->linkOwner(prev, addr) : nullptr;
+        IRBlock *block = owner ? this->ir_cache->follow(owner, addr, M) : nullptr;
+
+        if (!block) {
+            block = this->ir_cache->lookup(addr, M);
+            if (!block) {
+                block = this->ir_cache->slot(addr);
+                this->translateBlock<M>(addr, block);
+            }
+            if (owner) this->ir_cache->link(owner, block);
+        }
+        prev = block;
+
+        u32 exit = NATIVE_NEXT;  // blocks never return it, so it means nothing native ran
+
+#ifdef ACCUI64_AOT
+        if (block->aot) {
+            exit = block->aot(this, block->insts.data(), &aot_helpers<M>);
+        }
+#endif
+#ifdef ACCUI64_JIT
+        if (exit == NATIVE_NEXT) {
+            if (!this->jit->valid(block) && ++block->runs >= Jit::HOT) {
+                this->jit->compile<M>(this, block);
+            }
+            if (this->jit->valid(block)) exit = block->code(this);
+        }
+#endif
+
+        if (exit == NATIVE_NEXT) {
+            if (!this->runIRBlock<M>(block)) this->traceStep(block->insts.size());
+            continue;
+        }
+
+        if (exit == NATIVE_FAULT) throw this->ir_cache->fault;
+        if (exit == NATIVE_DONE) this->traceStep(block->insts.size());
+    }
+}
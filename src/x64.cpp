@@ -1,15 +1,15 @@
 #include "../inc/debug.hpp"
+#include "../inc/hle.hpp"
 #include "../inc/ram.hpp"
 #include "../inc/x64.hpp"
+#include <bit>
+#include <cstring>
 #include <immintrin.h>
 #include <iomanip>
 #include <iostream>
 #include <variant>
 
 CPU::CPU() {
-    this->extra_info = std::unordered_map<const char *, u8>();
-    this->extra_info.clear();
-
     this->running = true;
 
     this->setupRegs();
@@ -17,7 +17,7 @@ CPU::CPU() {
 
 void CPU::setupRegs() {
     for (int i = 0; i < 0x10; i++) {
-        this->regs[i] = 0;
+        this->regs[i] = Reg();
     }
     this->IP->r = 0xFFF0;
 
@@ -64,38 +64,610 @@ void CPU::setupRegs() {
     }
 
     IA32_EFER = { 0 };
+
+    this->updateMode();
+}
+
+// picks the handler tables and decoder for the current CR0/CR4/EFER, called whenever one of them changes
+void CPU::updateMode() {
+    IA32_EFER.lma = CR0->pe && CR0->pg && CR4->pae && IA32_EFER.lme;
+
+    if (this->isLongMode()) {
+        this->mode = MODE_LONG;
+        this->active_decode = &CPU::decode<MODE_LONG>;
+        this->active_fused = &CPU::execFused<MODE_LONG>;
+    } else if (CR0->pe) {
+        this->mode = MODE_PROT;
+        this->active_decode = &CPU::decode<MODE_PROT>;
+        this->active_fused = &CPU::execFused<MODE_PROT>;
+    } else {
+        this->mode = MODE_REAL;
+        this->active_decode = &CPU::decode<MODE_REAL>;
+        this->active_fused = &CPU::execFused<MODE_REAL>;
+    }
+
+    this->active_table = &CPU::opcode_table[this->mode];
+    this->active_table_0F = &CPU::opcode_table_0F[this->mode];
 }
 
 void CPU::run() {
-    this->extra_info.insert({"rex", 0x00});
+    this->checkTriggers();
 
     std::cout << "---------------------------" << std::endl;
     std::cout << "EIP: " << std::hex << std::uppercase << (int)(CS->base + IP->e) << std::endl << std::endl;
+
+#if defined(ACCUI64_IR) || defined(ACCUI64_JIT) || defined(ACCUI64_AOT)
     while (this->running) {
-        if (this->runStep()) continue;
-        
-        std::cout << std::endl;
-        this->debugPrintRegs();
-        std::cout << "---------------------------" << std::endl;
-        std::cout << "EIP: " << std::hex << std::uppercase << (int)(CS->base + IP->e) << std::endl << std::endl;
+        try {
+            switch (this->mode) {
+                case MODE_REAL: this->runIR<MODE_REAL>(); break;
+                case MODE_PROT: this->runIR<MODE_PROT>(); break;
+                case MODE_LONG: this->runIR<MODE_LONG>(); break;
+            }
+        } catch (const CPUFault &fault) {
+            this->handleFault(fault);
+        }
+    }
+#elif defined(ACCUI64_THREADED)
+    while (this->running) {
+        try {
+#ifdef ACCUI64_HLE
+            if (this->hle && this->hle->enter(this)) {
+                this->traceStep();
+                continue;
+            }
+#endif
+            switch (this->mode) {
+                case MODE_REAL: this->runThreaded<MODE_REAL>(); break;
+                case MODE_PROT: this->runThreaded<MODE_PROT>(); break;
+                case MODE_LONG: this->runThreaded<MODE_LONG>(); break;
+            }
+        } catch (const CPUFault &fault) {
+            this->handleFault(fault);
+        }
+    }
+#else
+    while (this->running) {
+        try {
+            if (this->runStep()) continue;
+        } catch (const CPUFault &fault) {
+            this->handleFault(fault);
+        }
+
+        this->traceStep();
+    }
+#endif
+
+    this->debugPrintFusion();
+}
+
+// no IDT delivery yet, the faulting instruction is dropped like before
+void CPU::handleFault(const CPUFault &fault) {
+    std::cout << "FAULT " << (int)fault.type << " AT 0x" << std::hex << std::uppercase << fault.addr << std::endl;
+}
+
+// after every instruction, or every IR block, that did not halt
+void CPU::traceStep(u64 insts) {
+    this->retired += insts;
+    if (!this->triggers.empty()) this->checkTriggers();
+    if (this->tier == Tier::FAST) return;
+
+    std::cout << std::endl;
+    this->debugPrintRegs();
+    std::cout << "---------------------------" << std::endl;
+    std::cout << "EIP: " << std::hex << std::uppercase << (int)(CS->base + IP->e) << std::endl << std::endl;
+}
+
+// the handlers print wherever they like, so the fast tier mutes std::cout as a whole
+void CPU::setTier(Tier tier) {
+    if (tier == this->tier) return;
+
+    if (tier == Tier::FAST) {
+        std::cout << "FAST FORWARD AT 0x" << std::hex << std::uppercase << (CS->base + IP->e)
+                  << " AFTER " << std::dec << this->retired << std::endl;
+        std::cout.setstate(std::ios::badbit);
+    } else {
+        std::cout.clear();
+        std::cout << "TRACE AT 0x" << std::hex << std::uppercase << (CS->base + IP->e)
+                  << " AFTER " << std::dec << this->retired << std::endl;
+    }
+    this->tier = tier;
+}
+
+// fires and drops every trigger that holds now. addresses are only seen where traceStep() runs,
+// which is every instruction for the interpreters but only block starts under the IR
+void CPU::checkTriggers(bool post) {
+    u64 addr = CS->base + IP->e;
+
+    for (auto it = this->triggers.begin(); it != this->triggers.end();) {
+        bool hit = false;
+        switch (it->kind) {
+            case TierTrigger::ADDR:  hit = addr == it->value; break;
+            case TierTrigger::COUNT: hit = this->retired >= it->value; break;
+            case TierTrigger::POST:  hit = post && this->post_code == it->value; break;
+        }
+
+        if (hit) {
+            this->setTier(it->to);
+            it = this->triggers.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
+
+// no devices yet, only the POST code port is watched
+void CPU::out(u16 port, u8 val) {
+    if (port == POST_PORT) {
+        this->post_code = val;
+        if (!this->triggers.empty()) this->checkTriggers(true);
     }
 }
 
 bool CPU::runStep() {
-    this->curr_inst = this->read();
+#ifdef ACCUI64_HLE
+    if (this->hle && this->hle->enter(this)) return false;
+#endif
+    this->fetchInst();
+    return this->execute();
+}
 
-    bool dont_clear = (this->*CPU::opcode_table[this->curr_inst])();
+// fills inst for the instruction at CS:IP, from the cache when possible, and moves IP past it
+void CPU::fetchInst() {
+    u64 addr = CS->base + IP->e;
 
-    if (!dont_clear) {
-        this->extra_info.clear();
-        this->extra_info.insert({"rex", 0x00});
+    DecodedInst *cached = this->icache.lookup(addr, this->mode);
+    if (cached) {
+        this->inst = *cached;
+    } else {
+        this->decodeBlock(addr);
+    }
+
+    if (this->mode == MODE_REAL) {
+        IP->x += this->inst.len;
+    } else {
+        IP->e += this->inst.len;
+    }
+}
+
+// decodes the straight-line run starting at addr into the cache, leaves the first instruction in inst
+void CPU::decodeBlock(u64 addr) {
+    DecodedInst block[MAX_BLOCK];
+    int count = this->decodeRun(addr, block);
+
+    for (int i = 0; i < count; i++) {
+        if (block[i].len <= sizeof(block[i].bytes)) {
+            this->icache.insert(block[i]);
+        }
+    }
+
+    this->inst = block[0];
+}
+
+// outside real mode a memory operand can fault, and handleFault() carries on past the instruction
+// without the flags it would have written. POPF reads the stack
+static bool mayFault(const DecodedInst &inst) {
+    if (inst.mode == MODE_REAL) return false;
+    return inst.opcode == 0x9D || (inst.has_modrm && inst.modrm._mod != 3);
+}
+
+// whether [addr, addr + len) is RAM or ROM. reading ahead anywhere else could reach a device for
+// bytes that never run
+static bool plainCode(u64 addr, u32 len) {
+    return RAM::hostPtr(addr) && RAM::hostPtr(addr + len - 1);
+}
+
+// decodes up to MAX_BLOCK instructions from addr until one that ends the block, then walks them
+// backwards to find which flags each one produces for a later reader. returns how many were decoded.
+// entries are only checked against the pages of their own bytes, so the run stops before anything
+// that reaches past the page it started on
+int CPU::decodeRun(u64 addr, DecodedInst *block) {
+    const u64 first_page = addr >> 12;
+    int count = 0;
+
+    while (count < MAX_BLOCK) {
+        if (count > 0 && !plainCode(addr, sizeof(this->inst.bytes))) break;
+
+        this->inst = DecodedInst();
+        this->inst.addr = addr;
+        this->inst.mode = this->mode;
+        this->inst.gen[0] = RAM::pageGen(addr);
+        this->inst.gen[1] = RAM::pageGen(addr + 14);
+
+        if (!this->takePredecoded(addr)) {
+            (this->*active_decode)();
+#ifndef ACCUI64_NO_FUSION
+            if (plainCode(addr + this->inst.len, 6)) this->fuse();  // a jcc rel32 is the most it looks at
+#endif
+        }
+        if ((this->inst.addr >> 12) == ((this->inst.addr + this->inst.len - 1) >> 12)) {
+            this->inst.gen[1] = this->inst.gen[0];
+        }
+        if (count > 0 && ((this->inst.addr + this->inst.len - 1) >> 12) != first_page) break;
+
+        block[count++] = this->inst;
+        addr += this->inst.len;
+
+        if (!this->inst.valid || this->inst.len > sizeof(this->inst.bytes)) break;
+        if (this->attrOf(this->inst)->ends_block || this->inst.fuse == FUSE_CMP_JCC) break;
+    }
+
+    u8 live = FL_STATUS;  // whatever the block falls or jumps into may read anything
+    for (int i = count - 1; i >= 0; i--) {
+        const OpAttr *attr = this->attrOf(block[i]);
+
+        block[i].flags_live = live;
+        if (!block[i].valid) {
+            live = FL_STATUS;
+        } else {
+            u8 writes = mayFault(block[i]) ? 0 : attr->fl_write;
+            live = (live & ~writes) | attr->fl_read;
+        }
+    }
+
+    return count;
+}
+
+// where code can go after the last instruction of a run, as displacements from the end of that run.
+// nothing for what only running it tells: RET, indirect jumps, HLT, mode switches
+template <CPUMode M>
+int CPU::runExits(const DecodedInst &last, s64 exits[2]) {
+    if (!last.valid || last.len > sizeof(last.bytes)) return 0;
+
+    if (last.fuse == FUSE_CMP_JCC) {
+        exits[0] = static_cast<s64>(last.fuse_imm);
+        exits[1] = 0;
+        return 2;
+    }
+    if (!attrOf(last)->ends_block) {
+        exits[0] = 0;  // ran into MAX_BLOCK
+        return 1;
+    }
+
+    s64 rel = (opSizeOf<M>(last.pfx) == RegType::R16) ? static_cast<s16>(last.imm) : static_cast<s32>(last.imm);
+
+    if ((last.opcode >= 0x70 && last.opcode <= 0x7F) || last.opcode == 0xEB) {
+        rel = static_cast<s8>(last.imm);
+    }
+
+    switch (last.opcode) {
+        case 0x70: case 0x71: case 0x72: case 0x73: case 0x74: case 0x75: case 0x76: case 0x77:
+        case 0x78: case 0x79: case 0x7A: case 0x7B: case 0x7C: case 0x7D: case 0x7E: case 0x7F:
+        case 0x0F80: case 0x0F81: case 0x0F82: case 0x0F83: case 0x0F84: case 0x0F85: case 0x0F86: case 0x0F87:
+        case 0x0F88: case 0x0F89: case 0x0F8A: case 0x0F8B: case 0x0F8C: case 0x0F8D: case 0x0F8E: case 0x0F8F:
+        case 0xE8:  // the call target, then where it returns to
+            exits[0] = rel;
+            exits[1] = 0;
+            return 2;
+
+        case 0xE9: case 0xEB:
+            exits[0] = rel;
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+// reads the whole instruction at CS:IP into inst, leaving IP after it
+template <CPUMode M>
+void CPU::decode() {
+    u8 op = this->decodePrefixes<M>();
+    const OpAttr *attr = &CPU::opcode_attr[op];
+    this->inst.opcode = op;
+
+    if (op == 0x0F) {
+        op = this->read();
+        attr = &CPU::opcode_attr_0F[op];
+        this->inst.opcode = 0x0F00 | op;
+    }
+
+    this->inst.valid = attr->modes & (1 << M);
+
+    u8 modrm_pos = this->inst.len;
+    if (attr->modrm) {
+        RegType type = (attr->size == OpSize::OS_B) ? RegType::R8 : RegType::R32;
+
+        if constexpr (M == MODE_REAL) {
+            this->getModRM16(&this->inst.modrm, type);
+        } else {
+            this->getModRM32(&this->inst.modrm, type);
+        }
+        this->inst.has_modrm = true;
+
+        switch (this->inst.modrm.disp) {
+            case 1: this->inst.disp = static_cast<s8>(this->read());     break;
+            case 2: this->inst.disp = static_cast<s16>(this->fetch16()); break;
+            case 4: this->inst.disp = this->fetch32(); break;
+        }
+        this->selectEA<M>();
+    }
+
+    RegType opsize = this->getOpSize<M>();
+
+    switch (attr->imm) {
+        case IMM_NONE: break;
+
+        case IMM_B: this->inst.imm = this->read();    break;
+        case IMM_W: this->inst.imm = this->fetch16(); break;
+
+        case IMM_Z:
+            this->inst.imm = (opsize == RegType::R16) ? this->fetch16() : this->fetch32();
+            break;
+
+        case IMM_V:
+            if (opsize == RegType::R16) {
+                this->inst.imm = this->fetch16();
+            } else {
+                this->inst.imm = this->fetch32();
+                if (opsize == RegType::R64) {
+                    this->inst.imm |= static_cast<u64>(this->fetch32()) << 32;
+                }
+            }
+            break;
+
+        case IMM_ENTER:
+            this->inst.imm = this->fetch16();
+            this->inst.imm |= static_cast<u64>(this->read()) << 16;
+            break;
+
+        case IMM_PTR:
+            this->inst.imm = (opsize == RegType::R16) ? this->fetch16() : this->fetch32();
+            this->inst.imm |= static_cast<u64>(this->fetch16()) << 32;
+            break;
+
+        case IMM_MOFFS:
+            if (M == MODE_LONG && !this->inst.pfx.ad) {
+                this->inst.imm = this->fetch32();
+                this->inst.imm |= static_cast<u64>(this->fetch32()) << 32;
+            } else if (M != MODE_LONG && (M == MODE_REAL) != this->inst.pfx.ad) {
+                this->inst.imm = this->fetch16();  // 67 in long mode gives 32 bits, never 16
+            } else {
+                this->inst.imm = this->fetch32();
+            }
+            break;
+
+        case IMM_GRP3:
+            if (getMask(this->inst.bytes[modrm_pos], 5, 3) < 2) {
+                if (attr->size == OpSize::OS_B) {
+                    this->inst.imm = this->read();
+                } else {
+                    this->inst.imm = (opsize == RegType::R16) ? this->fetch16() : this->fetch32();
+                }
+            }
+            break;
+    }
+}
+
+bool CPU::execute() {
+    if (this->inst.fuse != FUSE_NONE) {
+        return (this->*active_fused)();
+    }
+
+    if (!this->inst.valid) {
+        return this->invalidOpcode();
+    }
+
+    if (this->inst.opcode > 0xFF) {
+        this->curr_inst = this->inst.opcode & 0xFF;
+        return (this->*(*this->active_table_0F)[this->curr_inst])();
+    }
+
+    this->curr_inst = this->inst.opcode;
+    return (this->*(*this->active_table)[this->curr_inst])();
+}
+
+// folds the next instruction into inst for the idioms execFused() handles, runs once per decode
+// so cached entries keep the fused form. leaves inst alone when nothing matches
+void CPU::fuse() {
+    if (!this->inst.valid || this->inst.pfx.lock || this->inst.pfx.rep || this->inst.pfx.seg != 0xFF) {
+        return;
+    }
+
+    ModRM *modrm = &this->inst.modrm;
+    bool reg_form = this->inst.has_modrm && modrm->_mod == 3;
+
+    switch (this->inst.opcode) {
+        default: break;
+
+        // only where the handlers implement them, the fused form has to do what they do
+        case 0x29: case 0x31:
+            if (this->inst.mode == MODE_REAL && reg_form && modrm->_reg == modrm->_rm) {
+                this->inst.fuse = FUSE_ZERO;
+            }
+            break;
+
+        case 0x38: case 0x39: case 0x3A: case 0x3B: case 0x84: case 0x85:
+            if (reg_form && this->fuseJcc()) {
+                this->inst.fuse = FUSE_CMP_JCC;
+            }
+            break;
+
+        case 0x3C: case 0x3D: case 0xA8: case 0xA9:
+            if (this->fuseJcc()) {
+                this->inst.fuse = FUSE_CMP_JCC;
+            }
+            break;
+
+        case 0xB8: case 0xB9: case 0xBA: case 0xBB: case 0xBC: case 0xBD: case 0xBE: case 0xBF: {
+            if (this->inst.pfx.op || this->inst.pfx.has_rex) break;
+
+            u8 len = this->inst.len;
+            u8 next = this->fetch<u8>();
+
+            if ((next & 0xF8) == 0xB8) {
+                this->inst.fuse_op  = next & 7;
+                this->inst.fuse_imm = (this->inst.mode == MODE_REAL) ? this->fetch16() : this->fetch32();
+            }
+            if ((next & 0xF8) != 0xB8 || this->inst.len > sizeof(this->inst.bytes)) {
+                this->inst.len = len;
+                break;
+            }
+            this->inst.fuse = FUSE_MOV_IMM;
+            break;
+        }
+    }
+}
+
+// appends a following Jcc (70-7F or 0F 80-8F without prefixes) to inst
+bool CPU::fuseJcc() {
+    u8 len = this->inst.len;
+    u8 next = this->fetch<u8>();
+    bool ok = false;
+
+    if ((next & 0xF0) == 0x70) {
+        this->inst.fuse_op  = next & 0xF;
+        this->inst.fuse_imm = static_cast<s8>(this->fetch<u8>());
+        ok = true;
+    } else if (next == 0x0F) {
+        next = this->fetch<u8>();
+        if ((next & 0xF0) == 0x80) {
+            this->inst.fuse_op = next & 0xF;
+            if (this->inst.mode == MODE_REAL) {
+                this->inst.fuse_imm = static_cast<s16>(this->fetch16());
+            } else {
+                this->inst.fuse_imm = static_cast<s32>(this->fetch32());
+            }
+            ok = true;
+        }
+    }
+
+    if (!ok || this->inst.len > sizeof(this->inst.bytes)) {
+        this->inst.len = len;
+        return false;
+    }
+    return true;
+}
+
+template <CPUMode M>
+bool CPU::execFused() {
+    this->fuse_hits[this->inst.fuse]++;
+    this->curr_inst = this->inst.opcode;
+
+    switch (this->inst.fuse) {
+        default: break;
+
+        // result and flags are known without running the ALU op
+        case FUSE_ZERO: {
+            ModRM *modrm = this->getModRM();
+            Reg *dst = this->toReg(modrm->rm);
+
+            if (modrm->rm_type == RegType::R16) {
+                dst->x = 0;
+            } else {
+                dst->r = 0;
+            }
+
+            if (this->inst.flags_live) this->zeroFlags();
+
+            debugPrint((this->curr_inst >= 0x30) ? "XOR" : "SUB", modrm, 0, 0, RM_R);
+            break;
+        }
+
+        // the compare only records its operands, the branch reads them back through lazy.cond()
+        case FUSE_CMP_JCC: {
+            (this->*CPU::opcode_table[M][this->curr_inst])();
+
+            u8 cc = this->inst.fuse_op;
+            if (this->lazy.cond(cc)) {
+                if constexpr (M == MODE_REAL) {
+                    IP->x += this->inst.fuse_imm;
+                } else {
+                    IP->e += this->inst.fuse_imm;
+                }
+            }
+
+            std::cout << "J" << getCondName(cc) << " " << std::hex << (int)this->inst.fuse_imm << std::endl;
+            break;
+        }
+
+        case FUSE_MOV_IMM: {
+            this->movRegImm<M>();
+
+            Reg *dst = &this->regs[this->inst.fuse_op];
+            RegType type = (M == MODE_REAL) ? RegType::R16 : RegType::R32;
+
+            if constexpr (M == MODE_REAL) {
+                dst->x = this->inst.fuse_imm;
+            } else {
+                dst->r = static_cast<u32>(this->inst.fuse_imm);
+            }
+
+            std::cout << "MOV " << getRegName(this->inst.fuse_op, type) << ", " << std::hex << std::uppercase << this->inst.fuse_imm << std::endl;
+            break;
+        }
+    }
+
+    return false;
+}
+
+// reads legacy and REX prefixes into inst.pfx, returns the opcode byte after them
+template <CPUMode M>
+u8 CPU::decodePrefixes() {
+    Prefixes &pfx = this->inst.pfx;
+
+    while (true) {
+        u8 val = this->read();
+
+        switch (val) {
+            case 0x66: pfx.op   = true; break;
+            case 0x67: pfx.ad   = true; break;
+            case 0xF0: pfx.lock = true; break;
+            case 0xF2: case 0xF3: pfx.rep = val; break;
+
+            case 0x26: pfx.seg = 0; break;
+            case 0x2E: pfx.seg = 1; break;
+            case 0x36: pfx.seg = 2; break;
+            case 0x3E: pfx.seg = 3; break;
+            case 0x64: pfx.seg = 4; break;
+            case 0x65: pfx.seg = 5; break;
+
+            default:
+                if (M == MODE_LONG && (val & 0xF0) == 0x40) {
+                    pfx.has_rex = true;
+                    pfx.rex = val & 0x0F;
+                    continue;
+                }
+                return val;
+        }
+
+        // REX only counts when it is the last prefix
+        pfx.has_rex = false;
+        pfx.rex = 0;
     }
-    return dont_clear;
 }
 
 u8 CPU::read() {
-    u8 ret = RAM::read(CS->base + IP->e);
-    IP->x++;
+    return this->fetch<u8>();
+}
+
+// next T from the instruction stream at inst.addr + inst.len, served from fetch_win.
+// IP is left alone here, fetchInst() moves it past the whole instruction once decoded
+template <typename T>
+T CPU::fetch() {
+    u64 addr = this->inst.addr + this->inst.len;
+    T ret;
+
+    if (!this->fetch_win.contains(addr, sizeof(T))) {
+        u64 page = addr & ~(FetchWindow::PAGE - 1);
+        this->fetch_win.base = page;
+        this->fetch_win.host = RAM::hostPtr(page);
+    }
+
+    if (this->fetch_win.contains(addr, sizeof(T))) {
+        std::memcpy(&ret, this->fetch_win.host + (addr - this->fetch_win.base), sizeof(T));
+    } else { // straddles the page end
+        u8 buf[sizeof(T)];
+        for (u32 i = 0; i < sizeof(T); i++) {
+            buf[i] = RAM::read(addr + i);
+        }
+        std::memcpy(&ret, buf, sizeof(T));
+    }
+
+    if (this->inst.len + sizeof(T) <= sizeof(this->inst.bytes)) {
+        std::memcpy(this->inst.bytes + this->inst.len, &ret, sizeof(T));
+    }
+    this->inst.len += sizeof(T);
 
     return ret;
 }
@@ -105,141 +677,170 @@ void CPU::write(u64 addr, u8 val) {
 }
 
 void CPU::writeReg(u64 addr, Reg *reg, RegType type) {
-    auto val = reg->get(type);
-    std::visit([&](auto write) {
-        using T = decltype(write);
+    switch (type) {
+        case RegType::R8:  RAM::write<u8>(addr, reg->l); break;
+        case RegType::R8H: RAM::write<u8>(addr, reg->h); break;
+        case RegType::R16: RAM::write<u16>(addr, reg->x); break;
+        case RegType::R32: RAM::write<u32>(addr, reg->e); break;
+        case RegType::R64: RAM::write<u64>(addr, reg->r); break;
+        default: break;
+    }
+}
 
-        for (int i = 0; i < sizeof(T); i++) {
-            this->write(addr + i, write >> (i * 8));
-        }
-    }, val);
+u16 CPU::fetch16() {
+    return this->fetch<u16>();
+}
+
+u32 CPU::fetch32() {
+    return this->fetch<u32>();
 }
 
 u8 CPU::getVal8() {
-    return this->read();
+    return this->inst.imm;
 }
 
 u16 CPU::getVal16() {
-    return this->read() + (this->read() << 8);
+    return this->inst.imm;
 }
 
 u32 CPU::getVal32() {
-    u32 val = this->read();
-    val |= static_cast<u32>(this->read()) << 8;
-    val |= static_cast<u32>(this->read()) << 16;
-    val |= static_cast<u32>(this->read()) << 24;
-    return val;
+    return this->inst.imm;
 }
 
-bool CPU::checkExceptions(u64 ptr, const std::vector<ExceptionType> &exceptions) {
-    // Check for basic protection faults
-    if (CR0->pe) {  // Protected mode checks
-        for (const auto &exception : exceptions) {
-            switch (exception) {
-                case ExceptionType::DE:  // Divide Error
-                    // Handled during division operations
-                    break;
-                    
-                case ExceptionType::DB:  // Debug Exception
-                    // Check debug registers if any breakpoints are hit
-                    for (int i = 0; i < 4; i++) {
-                        if (DR7->get_enable(i) && ptr == this->db_regs[i]) return true;
-                    }
-                    break;
-                    
-                case ExceptionType::NMI:  // Non-Maskable Interrupt
-                    // External hardware interrupt, not checked here
-                    break;
-                    
-                case ExceptionType::BP:  // Breakpoint
-                    // Software triggered (INT3), not checked here
-                    break;
-                    
-                case ExceptionType::OF:  // Overflow
-                    // Handled in arithmetic operations
-                    break;
-                    
-                case ExceptionType::BR:  // BOUND Range exceeded
-                    // Handled in BOUND instruction
-                    break;
-                    
-                case ExceptionType::UD:  // Invalid Opcode
-                    // Handled during instruction decode
-                    break;
-                    
-                case ExceptionType::NM:  // Device Not Available
-                    if (CR0->em || CR0->ts) return true;
-                    break;
-                    
-                case ExceptionType::DF:  // Double Fault
-                    // Complex exception handling, not implemented here
-                    break;
-                    
-                case ExceptionType::CSO:  // Coprocessor Segment Overrun
-                    // Legacy exception, not used in modern CPUs
-                    break;
-                    
-                case ExceptionType::TS:  // Invalid TSS
-                    // Task switching not implemented yet
-                    break;
-                    
-                case ExceptionType::NP:  // Segment Not Present
-                    // Check segment presence
-                    if (!(CS->attr & 0x80)) return true;
-                    break;
-                    
-                case ExceptionType::SS:  // Stack Segment Fault
-                    // Check stack segment access
-                    if ((ptr >= SS->base) && (ptr <= SS->base + SS->limit)) {
-                        if (!(SS->attr & 0x2)) return true;  // Write protect check
-                    }
-                    break;
-                    
-                case ExceptionType::GP:  // General Protection Fault
-                    // Check segment limits and privileges
-                    if (ptr > CS->limit) return true;
-                    break;
-                    
-                case ExceptionType::PF:  // Page Fault
-                    if (CR0->pg) {  // Paging enabled
-                        // Basic page presence check
-                        // Note: Full paging implementation would need page table walk
-                        if (ptr > 0xFFFFFFFF) return true;
-                    }
-                    break;
-                    
-                case ExceptionType::MF:  // x87 FPU Floating-Point Error
-                    // FPU errors handled separately
-                    break;
-                    
-                case ExceptionType::AC:  // Alignment Check
-                    if (CR0->am && (RFLAGS.ac)) {
-                        if (ptr & 0x3) return true;  // Check if address is aligned
-                    }
-                    break;
-                    
-                case ExceptionType::MC:  // Machine Check
-                    // Hardware-level errors, not implemented
-                    break;
-                    
-                case ExceptionType::XM:  // SIMD Floating-Point Exception
-                    // SIMD errors handled separately
-                    break;
-                    
-                case ExceptionType::VE:  // Virtualization Exception
-                    // Virtualization events not implemented
-                    break;
-                    
-                case ExceptionType::SX:  // Security Exception
-                    // Security violations not implemented
-                    break;
-                    
-                default:
-                    break;
-            }
+// only the classes in Mask that apply to mode M are checked, the rest compile away.
+// DE, OF, BR, UD, MF and XM are raised by the instructions themselves, not here
+template <CPUMode M, u32 Mask>
+void CPU::checkExceptions(u64 ptr) {
+    if constexpr (M == MODE_REAL) {
+        return;
+    }
+
+    if constexpr (Mask & excMask<DB>) { // debug registers
+        for (int i = 0; i < 4; i++) {
+            if (DR7->get_enable(i) && ptr == this->db_regs[i]) this->raiseFault(DB, ptr);
         }
     }
-    return false;
+
+    if constexpr (Mask & excMask<NM>) {
+        if (CR0->em || CR0->ts) this->raiseFault(NM, ptr);
+    }
+
+    if constexpr (Mask & excMask<NP>) {
+        if (!(CS->attr & 0x80)) this->raiseFault(NP, ptr);
+    }
+
+    // segment limits are not checked in 64-bit mode
+    if constexpr (M != MODE_LONG && (Mask & excMask<ExceptionType::SS>)) {
+        if ((ptr >= SS->base) && (ptr <= SS->base + SS->limit)) {
+            if (!(SS->attr & 0x2)) this->raiseFault(ExceptionType::SS, ptr);  // Write protect check
+        }
+    }
+
+    if constexpr (M != MODE_LONG && (Mask & excMask<GP>)) {
+        if (ptr > CS->limit) this->raiseFault(GP, ptr);
+    }
+
+    if constexpr (Mask & excMask<PF>) {
+        // Note: Full paging implementation would need page table walk
+        if (CR0->pg && ptr > 0xFFFFFFFF) this->raiseFault(PF, ptr);
+    }
+
+    if constexpr (Mask & excMask<AC>) {
+        if (CR0->am && this->RFLAGS.ac && (ptr & 0x3)) this->raiseFault(AC, ptr);
+    }
+}
+
+[[gnu::cold, gnu::noinline]]
+void CPU::raiseFault(ExceptionType type, u64 ptr) {
+    throw CPUFault { type, ptr };
+}
+
+Flags &CPU::getFlags() {
+    if (this->lazy.op != FlagOp::NONE) {
+        RFLAGS.cf = this->lazy.cf();
+        RFLAGS.pf = this->lazy.pf();
+        RFLAGS.af = this->lazy.af();
+        RFLAGS.zf = this->lazy.zf();
+        RFLAGS.sf = this->lazy.sf();
+        RFLAGS.of = this->lazy.of();
+        this->lazy.op = FlagOp::NONE;
+    }
+    return RFLAGS;
+}
+
+u64 CPU::getFlagsVal() {
+    u64 val;
+    std::memcpy(&val, &this->getFlags(), sizeof(val));
+    return val;
+}
+
+void CPU::setFlagsVal(u64 val, u64 mask) {
+    u64 old = this->getFlagsVal();
+    RFLAGS = std::bit_cast<Flags>((old & ~mask) | (val & mask));
+}
+
+bool CPU::testCond(u8 cc) {
+    bool res;
+
+    switch (cc >> 1) {
+        default:
+        case 0: res = this->getOF(); break;
+        case 1: res = this->getCF(); break;
+        case 2: res = this->getZF(); break;
+        case 3: res = this->getCF() || this->getZF(); break;
+        case 4: res = this->getSF(); break;
+        case 5: res = this->getPF(); break;
+        case 6: res = this->getSF() != this->getOF(); break;
+        case 7: res = this->getZF() || (this->getSF() != this->getOF()); break;
+    }
+
+    return res ^ (cc & 1);
+}
+
+void CPU::push(u64 val, RegType type) {
+    u8 size = (type == RegType::R16) ? 2 : (type == RegType::R32) ? 4 : 8;
+    Reg reg = Reg();
+    reg.r = val;
+
+    switch (this->mode) {
+        case MODE_REAL:
+            SP->x -= size;
+            this->writeReg(SS->base + SP->x, &reg, type);
+            break;
+        case MODE_PROT:
+            SP->e -= size;
+            this->writeReg(SS->base + SP->e, &reg, type);
+            break;
+        case MODE_LONG:
+            SP->r -= size;
+            this->writeReg(SP->r, &reg, type);  // SS has no base in long mode
+            break;
+    }
+}
+
+u64 CPU::pop(RegType type) {
+    u8 size = (type == RegType::R16) ? 2 : (type == RegType::R32) ? 4 : 8;
+    u64 val = 0;
+
+    switch (this->mode) {
+        case MODE_REAL:
+            val = this->readMem(SS->base + SP->x, type);
+            SP->x += size;
+            break;
+        case MODE_PROT:
+            val = this->readMem(SS->base + SP->e, type);
+            SP->e += size;
+            break;
+        case MODE_LONG:
+            val = this->readMem(SP->r, type);
+            SP->r += size;
+            break;
+    }
+    return val;
+}
+
+u64 CPU::readMem(u64 addr, RegType type) {
+    return Reg(addr, type).r;
 }
 
 bool CPU::HALT() {
@@ -247,9 +848,14 @@ bool CPU::HALT() {
     return true;
 }
 
+bool CPU::invalidOpcode() {
+    std::cout << "INVALID OPCODE 0x" << std::hex << std::uppercase << (int)this->inst.opcode << std::endl;
+    return this->HALT();
+}
+
 void CPU::determineModRMMod3(ModRM *modrm, RegType type) {
-    u8 rmidx  = ((this->extra_info["rex"] & REXBit::B) << 3) | modrm->_rm ;
-    u8 regidx = ((this->extra_info["rex"] & REXBit::R) << 3) | modrm->_reg;
+    u8 rmidx  = this->inst.pfx.rexB() | modrm->_rm ;
+    u8 regidx = this->inst.pfx.rexR() | modrm->_reg;
     
     switch (type) {
         case RegType::R8: case RegType::R8H:
@@ -265,10 +871,10 @@ void CPU::determineModRMMod3(ModRM *modrm, RegType type) {
         case RegType::R16: case RegType::R32: case RegType::R64:
             modrm->reg_type = modrm->rm_type  = RegType::R32;
 
-            if (this->extra_info.contains("op")) { // TODO order
+            if (this->inst.pfx.op) { // TODO order
                 modrm->reg_type = modrm->rm_type  = RegType::R16;
             }
-            if (this->extra_info["rex"] & REXBit::W) {
+            if (this->inst.pfx.rex & REXBit::W) {
                 modrm->reg_type = modrm->rm_type  = RegType::R64;
             }
             modrm->rm  = &this->regs[rmidx ];
@@ -299,13 +905,13 @@ void CPU::determineModRMMod3(ModRM *modrm, RegType type) {
 }
 
 void CPU::determineModRMMod0to2(ModRM *modrm, RegType type) {
-    u8 rmidx  = ((this->extra_info["rex"] & REXBit::B) << 3) | modrm->_rm ;
-    u8 regidx = ((this->extra_info["rex"] & REXBit::R) << 3) | modrm->_reg;
+    u8 rmidx  = this->inst.pfx.rexB() | modrm->_rm ;
+    u8 regidx = this->inst.pfx.rexR() | modrm->_reg;
 
     std::cout << "MODRM: MOD " << (int)modrm->_mod << " | REG " << (int)regidx << " | RM " << (int)rmidx << std::endl;
 
     modrm->rm_type = RegType::R64;
-    if (this->extra_info.contains("ad")) {
+    if (this->inst.pfx.ad) {
         modrm->rm_type = RegType::R32;
     }
 
@@ -313,7 +919,7 @@ void CPU::determineModRMMod0to2(ModRM *modrm, RegType type) {
         case RegType::R8: case RegType::R8H:
             modrm->reg_type = RegType::R8;
 
-            if (modrm->_reg >= 4 && modrm->_reg < 8 && !this->extra_info.contains("rex")) {
+            if (modrm->_reg >= 4 && modrm->_reg < 8 && !this->inst.pfx.has_rex) {
                 modrm->_reg -= 4; modrm->reg_type = RegType::R8H;
             }
             modrm->rm  = &this->regs[rmidx ];
@@ -323,10 +929,10 @@ void CPU::determineModRMMod0to2(ModRM *modrm, RegType type) {
         case RegType::R16: case RegType::R32: case RegType::R64:
             modrm->reg_type = RegType::R32;
 
-            if (this->extra_info.contains("op")) { // TODO order
+            if (this->inst.pfx.op) { // TODO order
                 modrm->reg_type = RegType::R16;
             }
-            if (this->extra_info["rex"] & REXBit::W) {
+            if (this->inst.pfx.rex & REXBit::W) {
                 modrm->reg_type = RegType::R64;
             }
             modrm->rm  = &this->regs[rmidx ];
@@ -358,16 +964,16 @@ void CPU::determineModRMMod0to2(ModRM *modrm, RegType type) {
 
 void CPU::determineModRMSib(ModRM *modrm, RegType type, u8 sib) {
     modrm->sib._ss   = getMask(sib, 7, 6);
-    modrm->sib._base = getMask(sib, 5, 3);
-    modrm->sib._idx  = getMask(sib, 2, 0);
+    modrm->sib._idx  = getMask(sib, 5, 3);
+    modrm->sib._base = getMask(sib, 2, 0);
     
-    u8 idxidx  = ((this->extra_info["rex"] & REXBit::X) << 3) | modrm->sib._idx;
-    u8 baseidx = ((this->extra_info["rex"] & REXBit::B) << 3) | modrm->sib._base;
-    u8 regidx = ((this->extra_info["rex"] & REXBit::R)  << 3) | modrm->_reg;
+    u8 idxidx  = this->inst.pfx.rexX() | modrm->sib._idx;
+    u8 baseidx = this->inst.pfx.rexB() | modrm->sib._base;
+    u8 regidx  = this->inst.pfx.rexR() | modrm->_reg;
 
     modrm->sib.idx  = (idxidx == 4) ? nullptr : &this->regs[idxidx];
     modrm->sib.base = &this->regs[baseidx];
-    modrm->sib.mul  = (modrm->sib._ss != 0) ? modrm->sib._ss * 2 : 1;
+    modrm->sib.mul  = 1 << modrm->sib._ss;
 
     if (modrm->sib._base == 5 && modrm->_mod == 0) {
         modrm->disp = 4;
@@ -377,7 +983,7 @@ void CPU::determineModRMSib(ModRM *modrm, RegType type, u8 sib) {
 
     modrm->sib.idx_type  = RegType::R64;
     modrm->sib.base_type = RegType::R64;
-    if (this->extra_info.contains("ad")) {
+    if (this->inst.pfx.ad) {
         modrm->sib.idx_type  = RegType::R32;
         modrm->sib.base_type = RegType::R32;
     }
@@ -386,7 +992,7 @@ void CPU::determineModRMSib(ModRM *modrm, RegType type, u8 sib) {
         case RegType::R8: case RegType::R8H:
             modrm->reg_type = RegType::R8;
 
-            if (modrm->_reg >= 4 && modrm->_reg < 8 && this->extra_info["rex"] == 0x00) {
+            if (modrm->_reg >= 4 && modrm->_reg < 8 && !this->inst.pfx.has_rex) {
                 modrm->_reg -= 4; modrm->reg_type = RegType::R8H;
             }
             modrm->reg = &this->regs[regidx];
@@ -395,10 +1001,10 @@ void CPU::determineModRMSib(ModRM *modrm, RegType type, u8 sib) {
         case RegType::R16: case RegType::R32: case RegType::R64:
             modrm->reg_type = RegType::R32;
 
-            if (this->extra_info.contains("op")) { // TODO order
+            if (this->inst.pfx.op) { // TODO order
                 modrm->reg_type = RegType::R16;
             }
-            if (this->extra_info["rex"] & REXBit::W) {
+            if (this->inst.pfx.rex & REXBit::W) {
                 modrm->reg_type = RegType::R64;
             }
             modrm->reg = &this->regs[regidx];
@@ -421,9 +1027,9 @@ void CPU::determineModRMSib(ModRM *modrm, RegType type, u8 sib) {
     }
 }
 
-ModRM *CPU::getModRM16(RegType type) {
+void CPU::getModRM16(ModRM *modrm, RegType type) {
     u8 val = this->read();
-    ModRM *modrm = new ModRM(
+    *modrm = ModRM(
         getMask(val, 7, 6),
         getMask(val, 5, 3),
         getMask(val, 2, 0)
@@ -458,7 +1064,7 @@ ModRM *CPU::getModRM16(RegType type) {
     modrm->rm_type  = RegType::R16;
     modrm->sib.idx_type  = RegType::R16;
     modrm->sib.base_type = RegType::R16;
-    if (this->extra_info.contains("ad")) {
+    if (this->inst.pfx.ad) {
         modrm->rm_type  = RegType::R32;
         modrm->sib.idx_type  = RegType::R32;
         modrm->sib.base_type = RegType::R32;
@@ -480,7 +1086,7 @@ detType:
         case RegType::R16: case RegType::R32:
             modrm->reg_type = RegType::R16;
 
-            if (this->extra_info.contains("op")) {
+            if (this->inst.pfx.op) {
                 modrm->reg_type = RegType::R32;
             }
             modrm->reg = &this->regs[modrm->_reg];
@@ -489,13 +1095,11 @@ detType:
     if (mod3) {
         modrm->rm_type = modrm->reg_type;
     }
-
-    return modrm;
 }
 
-ModRM *CPU::getModRM32(RegType type) {
+void CPU::getModRM32(ModRM *modrm, RegType type) {
     u8 val = this->read();
-    ModRM *modrm = new ModRM(
+    *modrm = ModRM(
         getMask(val, 7, 6),
         getMask(val, 5, 3),
         getMask(val, 2, 0)
@@ -509,12 +1113,12 @@ ModRM *CPU::getModRM32(RegType type) {
 
     if (modrm->_mod == 3) {
         this->determineModRMMod3(modrm, type);
-        return modrm;
+        return;
     }
 
     if (modrm->_rm == 4) {
         this->determineModRMSib(modrm, type, this->read());
-        return modrm;
+        return;
     }
 
     if (modrm->_rm == 5 && modrm->_mod == 0) {
@@ -523,40 +1127,127 @@ ModRM *CPU::getModRM32(RegType type) {
     }
 
     this->determineModRMMod0to2(modrm, type);
-    return modrm;
 }
 
-ModRM *CPU::getModRM(RegType type) {
-    if (!CR0->pe) {
-        return this->getModRM16(type);
-    } else {
-        return this->getModRM32(type);
-    }
+// [base + idx * 2^scale + disp] wrapped to the address size A
+template <typename A, bool Base, bool Idx, bool Disp>
+static u64 eaCalc(CPU *cpu, const DecodedInst *inst) {
+    u64 val = 0;
+
+    if constexpr (Base) val += cpu->regs[inst->ea_base].r;
+    if constexpr (Idx)  val += cpu->regs[inst->ea_idx].r << inst->ea_scale;
+    if constexpr (Disp) val += static_cast<s64>(static_cast<s32>(inst->disp));
+
+    return static_cast<A>(val);
 }
 
-u64 CPU::getModRMPtr(ModRM *modrm, u32 &disp) {
-    u64 val = 0;
+// [rip + disp], IP already points past the instruction when this runs
+template <typename A>
+static u64 eaRip(CPU *cpu, const DecodedInst *inst) {
+    return static_cast<A>(cpu->IP->r + static_cast<s64>(static_cast<s32>(inst->disp)));
+}
 
-    if (!modrm->shouldUseSib()) {
-        val += regToMaxSize(this->toReg(modrm->rm)->get(modrm->rm_type));
-    } else {
-        if (modrm->sib.idx) {
-            val += regToMaxSize(this->toReg(modrm->sib.idx)->get(modrm->sib.idx_type));
-            val *= modrm->sib.mul;
+template <typename A>
+static EAFunc pickEA(bool base, bool idx, bool disp) {
+    static constexpr EAFunc table[8] = {
+        eaCalc<A, false, false, false>, eaCalc<A, false, false, true>,
+        eaCalc<A, false, true,  false>, eaCalc<A, false, true,  true>,
+        eaCalc<A, true,  false, false>, eaCalc<A, true,  false, true>,
+        eaCalc<A, true,  true,  false>, eaCalc<A, true,  true,  true>,
+    };
+    return table[base << 2 | idx << 1 | disp];
+}
+
+// resolves the decoded ModRM/SIB into register indices and one of the eaCalc forms
+template <CPUMode M>
+void CPU::selectEA() {
+    ModRM *modrm = &this->inst.modrm;
+    this->inst.ea = nullptr;
+
+    if (modrm->_mod == 3) {
+        return;
+    }
+
+    bool base = true;
+    bool idx  = false;
+    bool disp = modrm->disp != 0;
+    this->inst.ea_scale = 0;
+
+    if constexpr (M == MODE_REAL) {
+        static constexpr u8 base16[8] = { 3, 3, 5, 5, 6, 7, 5, 3 }; // BX BX BP BP SI DI BP BX
+        static constexpr u8 idx16[4]  = { 6, 7, 6, 7 };             // SI DI SI DI
+
+        this->inst.ea_base = base16[modrm->_rm];
+        if (modrm->_rm < 4) {
+            idx = true;
+            this->inst.ea_idx = idx16[modrm->_rm];
         }
-        if (modrm->sib.base) {
-            val += regToMaxSize(this->toReg(modrm->sib.base)->get(modrm->sib.base_type));
+        if (modrm->_mod == 0 && modrm->_rm == 6) {
+            base = false;
         }
+
+        this->inst.ea = this->inst.pfx.ad ? pickEA<u32>(base, idx, disp) : pickEA<u16>(base, idx, disp);
+        return;
     }
 
-    switch (modrm->disp) {
-        case 0: break;
-        case 1: val += disp = this->getVal8();  break;
-        case 2: val += disp = this->getVal16(); break;
-        case 4: val += disp = this->getVal32(); break;
+    if (modrm->_rm == 4) {
+        this->inst.ea_base  = this->inst.pfx.rexB() | modrm->sib._base;
+        this->inst.ea_idx   = this->inst.pfx.rexX() | modrm->sib._idx;
+        this->inst.ea_scale = modrm->sib._ss;
+
+        base = !(modrm->sib._base == 5 && modrm->_mod == 0);
+        idx  = this->inst.ea_idx != 4;
+    } else if (modrm->_rm == 5 && modrm->_mod == 0) {
+        if constexpr (M == MODE_LONG) {
+            this->inst.ea = this->inst.pfx.ad ? eaRip<u32> : eaRip<u64>;
+            return;
+        }
+        base = false;
+    } else {
+        this->inst.ea_base = this->inst.pfx.rexB() | modrm->_rm;
     }
 
-    return val;
+    if (M == MODE_LONG && !this->inst.pfx.ad) {
+        this->inst.ea = pickEA<u64>(base, idx, disp);
+    } else {
+        this->inst.ea = pickEA<u32>(base, idx, disp);
+    }
+}
+
+// handlers get a scratch copy of the decoded ModRM they are free to modify
+ModRM *CPU::getModRM() {
+    this->modrm_slot = this->inst.modrm;
+    return &this->modrm_slot;
+}
+
+Reg *CPU::getRMReg(ModRM *modrm, u64 ptr, Reg &mem) {
+    if (modrm->_mod == 3) {
+        return this->toReg(modrm->rm);
+    }
+
+    mem.r = this->readMem(ptr, modrm->reg_type);
+    return &mem;
+}
+
+u64 CPU::getModRMPtr(ModRM *modrm, u32 &disp) {
+    if (modrm->disp != 0) {
+        disp = this->inst.disp;
+    }
+    return this->inst.ea ? this->inst.ea(this, &this->inst) : 0;
+}
+
+DecodedInst *DecodeCache::lookup(u64 addr, CPUMode mode) {
+    DecodedInst *entry = &this->entries[index(addr)];
+
+    if (entry->addr != addr || entry->mode != mode) return nullptr;
+    if (entry->gen[0] != RAM::pageGen(addr)) return nullptr;
+    if (entry->gen[1] != RAM::pageGen(addr + entry->len - 1)) return nullptr;
+
+    return entry;
+}
+
+void DecodeCache::insert(const DecodedInst &inst) {
+    this->entries[index(inst.addr)] = inst;
 }
 
 void CPU::debugPrintRegs() {
@@ -573,9 +1264,107 @@ void CPU::debugPrintRegs() {
     }
 }
 
-#define SET(n) t[0x##n] = &CPU::OP_##n;
-#define SET0F(n) t[0x##n] = &CPU::OP_0F_##n;
+void CPU::debugPrintFusion() {
+    static const char *names[FUSE_COUNT] = { "", "ZERO", "CMP+JCC", "MOV+MOV" };
+
+    std::cout << "FUSED:";
+    for (int i = 1; i < FUSE_COUNT; i++) {
+        std::cout << " " << names[i] << " " << std::dec << this->fuse_hits[i];
+    }
+    std::cout << std::endl;
+}
+
+#ifdef ACCUI64_THREADED
+#if !defined(__GNUC__)
+#error "ACCUI64_THREADED needs computed goto (GCC or Clang)"
+#endif
+
+#define L(n) &&op_##n,
+#define H(n) op_##n: this->curr_inst = 0x##n; NEXT(this->OP_##n<M>());
+
+#ifdef ACCUI64_HLE
+#define HLE_EXIT() if (this->hle && this->hle->has(CS->base + IP->e)) return;
+#else
+#define HLE_EXIT()
+#endif
+
+#define NEXT(call)                                                      \
+    if (!(call)) this->traceStep();                                     \
+    if (!this->running || this->mode != M) return;                      \
+    HLE_EXIT()                                                          \
+    this->fetchInst();                                                  \
+    if (this->inst.fuse != FUSE_NONE) goto fused;                       \
+    if (!this->inst.valid) goto invalid;                                \
+    if (this->inst.opcode > 0xFF) goto map_0F;                          \
+    goto *labels[this->inst.opcode];
+
+// every handler ends in its own indirect jump to the next one instead of sharing the one in run(),
+// returns when the mode changes so run() can re-enter with the matching instantiation
+template <CPUMode M>
+void CPU::runThreaded() {
+    static void *const labels[0x100] = {
+        L(00)L(01)L(02)L(03)L(04)L(05)L(06)L(07)L(08)L(09)L(0A)L(0B)L(0C)L(0D)L(0E)L(0F)
+        L(10)L(11)L(12)L(13)L(14)L(15)L(16)L(17)L(18)L(19)L(1A)L(1B)L(1C)L(1D)L(1E)L(1F)
+        L(20)L(21)L(22)L(23)L(24)L(25)L(26)L(27)L(28)L(29)L(2A)L(2B)L(2C)L(2D)L(2E)L(2F)
+        L(30)L(31)L(32)L(33)L(34)L(35)L(36)L(37)L(38)L(39)L(3A)L(3B)L(3C)L(3D)L(3E)L(3F)
+        L(40)L(41)L(42)L(43)L(44)L(45)L(46)L(47)L(48)L(49)L(4A)L(4B)L(4C)L(4D)L(4E)L(4F)
+        L(50)L(51)L(52)L(53)L(54)L(55)L(56)L(57)L(58)L(59)L(5A)L(5B)L(5C)L(5D)L(5E)L(5F)
+        L(60)L(61)L(62)L(63)L(64)L(65)L(66)L(67)L(68)L(69)L(6A)L(6B)L(6C)L(6D)L(6E)L(6F)
+        L(70)L(71)L(72)L(73)L(74)L(75)L(76)L(77)L(78)L(79)L(7A)L(7B)L(7C)L(7D)L(7E)L(7F)
+        L(80)L(81)L(82)L(83)L(84)L(85)L(86)L(87)L(88)L(89)L(8A)L(8B)L(8C)L(8D)L(8E)L(8F)
+        L(90)L(91)L(92)L(93)L(94)L(95)L(96)L(97)L(98)L(99)L(9A)L(9B)L(9C)L(9D)L(9E)L(9F)
+        L(A0)L(A1)L(A2)L(A3)L(A4)L(A5)L(A6)L(A7)L(A8)L(A9)L(AA)L(AB)L(AC)L(AD)L(AE)L(AF)
+        L(B0)L(B1)L(B2)L(B3)L(B4)L(B5)L(B6)L(B7)L(B8)L(B9)L(BA)L(BB)L(BC)L(BD)L(BE)L(BF)
+        L(C0)L(C1)L(C2)L(C3)L(C4)L(C5)L(C6)L(C7)L(C8)L(C9)L(CA)L(CB)L(CC)L(CD)L(CE)L(CF)
+        L(D0)L(D1)L(D2)L(D3)L(D4)L(D5)L(D6)L(D7)L(D8)L(D9)L(DA)L(DB)L(DC)L(DD)L(DE)L(DF)
+        L(E0)L(E1)L(E2)L(E3)L(E4)L(E5)L(E6)L(E7)L(E8)L(E9)L(EA)L(EB)L(EC)L(ED)L(EE)L(EF)
+        L(F0)L(F1)L(F2)L(F3)L(F4)L(F5)L(F6)L(F7)L(F8)L(F9)L(FA)L(FB)L(FC)L(FD)L(FE)L(FF)
+    };
+
+    this->fetchInst();
+    if (this->inst.fuse != FUSE_NONE) goto fused;
+    if (!this->inst.valid) goto invalid;
+    if (this->inst.opcode > 0xFF) goto map_0F;
+    goto *labels[this->inst.opcode];
+
+    H(00)H(01)H(02)H(03)H(04)H(05)H(06)H(07)H(08)H(09)H(0A)H(0B)H(0C)H(0D)H(0E)H(0F)
+    H(10)H(11)H(12)H(13)H(14)H(15)H(16)H(17)H(18)H(19)H(1A)H(1B)H(1C)H(1D)H(1E)H(1F)
+    H(20)H(21)H(22)H(23)H(24)H(25)H(26)H(27)H(28)H(29)H(2A)H(2B)H(2C)H(2D)H(2E)H(2F)
+    H(30)H(31)H(32)H(33)H(34)H(35)H(36)H(37)H(38)H(39)H(3A)H(3B)H(3C)H(3D)H(3E)H(3F)
+    H(40)H(41)H(42)H(43)H(44)H(45)H(46)H(47)H(48)H(49)H(4A)H(4B)H(4C)H(4D)H(4E)H(4F)
+    H(50)H(51)H(52)H(53)H(54)H(55)H(56)H(57)H(58)H(59)H(5A)H(5B)H(5C)H(5D)H(5E)H(5F)
+    H(60)H(61)H(62)H(63)H(64)H(65)H(66)H(67)H(68)H(69)H(6A)H(6B)H(6C)H(6D)H(6E)H(6F)
+    H(70)H(71)H(72)H(73)H(74)H(75)H(76)H(77)H(78)H(79)H(7A)H(7B)H(7C)H(7D)H(7E)H(7F)
+    H(80)H(81)H(82)H(83)H(84)H(85)H(86)H(87)H(88)H(89)H(8A)H(8B)H(8C)H(8D)H(8E)H(8F)
+    H(90)H(91)H(92)H(93)H(94)H(95)H(96)H(97)H(98)H(99)H(9A)H(9B)H(9C)H(9D)H(9E)H(9F)
+    H(A0)H(A1)H(A2)H(A3)H(A4)H(A5)H(A6)H(A7)H(A8)H(A9)H(AA)H(AB)H(AC)H(AD)H(AE)H(AF)
+    H(B0)H(B1)H(B2)H(B3)H(B4)H(B5)H(B6)H(B7)H(B8)H(B9)H(BA)H(BB)H(BC)H(BD)H(BE)H(BF)
+    H(C0)H(C1)H(C2)H(C3)H(C4)H(C5)H(C6)H(C7)H(C8)H(C9)H(CA)H(CB)H(CC)H(CD)H(CE)H(CF)
+    H(D0)H(D1)H(D2)H(D3)H(D4)H(D5)H(D6)H(D7)H(D8)H(D9)H(DA)H(DB)H(DC)H(DD)H(DE)H(DF)
+    H(E0)H(E1)H(E2)H(E3)H(E4)H(E5)H(E6)H(E7)H(E8)H(E9)H(EA)H(EB)H(EC)H(ED)H(EE)H(EF)
+    H(F0)H(F1)H(F2)H(F3)H(F4)H(F5)H(F6)H(F7)H(F8)H(F9)H(FA)H(FB)H(FC)H(FD)H(FE)H(FF)
+
+map_0F:
+    this->curr_inst = this->inst.opcode & 0xFF;
+    NEXT((this->*CPU::opcode_table_0F[M][this->curr_inst])());
+
+fused:
+    NEXT(this->execFused<M>());
+
+invalid:
+    NEXT(this->invalidOpcode());
+}
 
+#undef NEXT
+#undef HLE_EXIT
+#undef H
+#undef L
+#endif
+
+#define SET(n) t[0x##n] = &CPU::OP_##n<M>;
+#define SET0F(n) t[0x##n] = &CPU::OP_0F_##n<M>;
+
+template <CPUMode M>
 static constexpr std::array<bool (CPU::*)(), 0x100> make_opcode_table() {
     std::array<bool (CPU::*)(), 0x100> t{};
 
@@ -598,6 +1387,7 @@ static constexpr std::array<bool (CPU::*)(), 0x100> make_opcode_table() {
 
     return t;
 }
+template <CPUMode M>
 static constexpr std::array<bool (CPU::*)(), 0x100> make_opcode_table_0F() {
     std::array<bool (CPU::*)(), 0x100> t{};
 
@@ -621,5 +1411,210 @@ static constexpr std::array<bool (CPU::*)(), 0x100> make_opcode_table_0F() {
     return t;
 }
 
-const std::array<bool (CPU::*)(), 0x100> CPU::opcode_table = make_opcode_table();
-const std::array<bool (CPU::*)(), 0x100> CPU::opcode_table_0F = make_opcode_table_0F();
\ No newline at end of file
+#define A(modrm, imm, size, modes) OpAttr{ modrm, imm, size, modes }
+
+// flags a jcc/setcc/cmovcc with condition cc looks at
+static constexpr u8 condFlags(u8 cc) {
+    constexpr u8 flags[8] = {
+        FL_OF, FL_CF, FL_ZF, FL_CF | FL_ZF, FL_SF, FL_PF, FL_SF | FL_OF, FL_ZF | FL_SF | FL_OF,
+    };
+    return flags[cc >> 1];
+}
+
+static constexpr std::array<OpAttr, 0x100> make_opcode_attr() {
+    std::array<OpAttr, 0x100> t{};
+    t.fill(A(false, IMM_NONE, OS_NONE, M_ALL));
+
+    // ADD OR ADC SBB AND SUB XOR CMP: Eb,Gb Ev,Gv Gb,Eb Gv,Ev AL,Ib eAX,Iz
+    for (int i = 0x00; i < 0x40; i += 8) {
+        t[i + 0] = A(true,  IMM_NONE, OS_B, M_ALL);
+        t[i + 1] = A(true,  IMM_NONE, OS_V, M_ALL);
+        t[i + 2] = A(true,  IMM_NONE, OS_B, M_ALL);
+        t[i + 3] = A(true,  IMM_NONE, OS_V, M_ALL);
+        t[i + 4] = A(false, IMM_B,    OS_B, M_ALL);
+        t[i + 5] = A(false, IMM_Z,    OS_V, M_ALL);
+    }
+    for (int i : { 0x06, 0x07, 0x0E, 0x16, 0x17, 0x1E, 0x1F, 0x27, 0x2F, 0x37, 0x3F }) {
+        t[i] = A(false, IMM_NONE, OS_NONE, M_LEGACY);
+    }
+    for (int i = 0x40; i < 0x50; i++) {
+        t[i] = A(false, IMM_NONE, OS_V, M_LEGACY);  // REX in long mode
+    }
+
+    t[0x60] = A(false, IMM_NONE, OS_V, M_LEGACY);
+    t[0x61] = A(false, IMM_NONE, OS_V, M_LEGACY);
+    t[0x62] = A(true,  IMM_NONE, OS_V, M_LEGACY);
+    t[0x63] = A(true,  IMM_NONE, OS_W, M_PROT | M_LONG);
+    t[0x68] = A(false, IMM_Z,    OS_V, M_ALL);
+    t[0x69] = A(true,  IMM_Z,    OS_V, M_ALL);
+    t[0x6A] = A(false, IMM_B,    OS_V, M_ALL);
+    t[0x6B] = A(true,  IMM_B,    OS_V, M_ALL);
+
+    for (int i = 0x70; i < 0x80; i++) {
+        t[i] = A(false, IMM_B, OS_NONE, M_ALL);
+    }
+
+    t[0x80] = A(true, IMM_B,    OS_B, M_ALL);
+    t[0x81] = A(true, IMM_Z,    OS_V, M_ALL);
+    t[0x82] = A(true, IMM_B,    OS_B, M_LEGACY);
+    t[0x83] = A(true, IMM_B,    OS_V, M_ALL);
+    for (int i = 0x84; i < 0x8C; i++) {
+        t[i] = A(true, IMM_NONE, (i & 1) ? OS_V : OS_B, M_ALL);
+    }
+    t[0x8C] = A(true, IMM_NONE, OS_W, M_ALL);
+    t[0x8D] = A(true, IMM_NONE, OS_V, M_ALL);
+    t[0x8E] = A(true, IMM_NONE, OS_W, M_ALL);
+    t[0x8F] = A(true, IMM_NONE, OS_V, M_ALL);
+
+    t[0x9A] = A(false, IMM_PTR, OS_V, M_LEGACY);
+
+    for (int i = 0xA0; i < 0xA4; i++) {
+        t[i] = A(false, IMM_MOFFS, (i & 1) ? OS_V : OS_B, M_ALL);
+    }
+    t[0xA8] = A(false, IMM_B, OS_B, M_ALL);
+    t[0xA9] = A(false, IMM_Z, OS_V, M_ALL);
+
+    for (int i = 0xB0; i < 0xB8; i++) {
+        t[i] = A(false, IMM_B, OS_B, M_ALL);
+    }
+    for (int i = 0xB8; i < 0xC0; i++) {
+        t[i] = A(false, IMM_V, OS_V, M_ALL);
+    }
+
+    t[0xC0] = A(true,  IMM_B,     OS_B, M_ALL);
+    t[0xC1] = A(true,  IMM_B,     OS_V, M_ALL);
+    t[0xC2] = A(false, IMM_W,     OS_NONE, M_ALL);
+    t[0xC4] = A(true,  IMM_NONE,  OS_V, M_LEGACY);  // VEX in long mode
+    t[0xC5] = A(true,  IMM_NONE,  OS_V, M_LEGACY);
+    t[0xC6] = A(true,  IMM_B,     OS_B, M_ALL);
+    t[0xC7] = A(true,  IMM_Z,     OS_V, M_ALL);
+    t[0xC8] = A(false, IMM_ENTER, OS_NONE, M_ALL);
+    t[0xCA] = A(false, IMM_W,     OS_NONE, M_ALL);
+    t[0xCD] = A(false, IMM_B,     OS_NONE, M_ALL);
+    t[0xCE] = A(false, IMM_NONE,  OS_NONE, M_LEGACY);
+
+    for (int i = 0xD0; i < 0xD4; i++) {
+        t[i] = A(true, IMM_NONE, (i & 1) ? OS_V : OS_B, M_ALL);
+    }
+    t[0xD4] = A(false, IMM_B,    OS_NONE, M_LEGACY);
+    t[0xD5] = A(false, IMM_B,    OS_NONE, M_LEGACY);
+    t[0xD6] = A(false, IMM_NONE, OS_NONE, M_LEGACY);
+    for (int i = 0xD8; i < 0xE0; i++) {
+        t[i] = A(true, IMM_NONE, OS_NONE, M_ALL);  // x87
+    }
+
+    for (int i = 0xE0; i < 0xE8; i++) {
+        t[i] = A(false, IMM_B, OS_NONE, M_ALL);
+    }
+    t[0xE8] = A(false, IMM_Z,   OS_NONE, M_ALL);
+    t[0xE9] = A(false, IMM_Z,   OS_NONE, M_ALL);
+    t[0xEA] = A(false, IMM_PTR, OS_NONE, M_LEGACY);
+    t[0xEB] = A(false, IMM_B,   OS_NONE, M_ALL);
+
+    t[0xF6] = A(true, IMM_GRP3, OS_B, M_ALL);
+    t[0xF7] = A(true, IMM_GRP3, OS_V, M_ALL);
+    t[0xFE] = A(true, IMM_NONE, OS_B, M_ALL);
+    t[0xFF] = A(true, IMM_NONE, OS_V, M_ALL);
+
+    // flag effects, ADC/SBB and the rotates through carry read CF
+    for (int i = 0x00; i < 0x40; i += 8) {
+        for (int j = 0; j < 6; j++) {
+            t[i + j].fl_read  = (i == 0x10 || i == 0x18) ? FL_CF : 0;
+            t[i + j].fl_write = FL_STATUS;
+        }
+    }
+    for (int i : { 0x84, 0x85, 0xA8, 0xA9 }) {
+        t[i].fl_read  = 0;
+        t[i].fl_write = FL_STATUS;
+    }
+    for (int i = 0x70; i < 0x80; i++) {
+        t[i].fl_read = condFlags(i & 0xF);
+    }
+    for (int i : { 0xC0, 0xC1, 0xD0, 0xD1, 0xD2, 0xD3 }) {
+        t[i].fl_read = FL_CF;
+    }
+    for (int i = 0x86; i < 0xA0; i++) {
+        t[i].fl_read = 0;  // XCHG MOV LEA POP NOP CBW CWD
+    }
+    for (int i = 0xB0; i < 0xC0; i++) {
+        t[i].fl_read = 0;
+    }
+    for (int i : { 0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x5B, 0x5C, 0x5D, 0x5E, 0x5F,
+                   0xC6, 0xC7, 0xE8, 0xE9, 0xEA, 0xEB, 0xFA, 0xFB, 0xFC, 0xFD }) {
+        t[i].fl_read = 0;
+    }
+    t[0x9C].fl_read  = FL_STATUS;                                // PUSHF
+    t[0x9D].fl_write = FL_STATUS;                                // POPF
+    t[0x9E].fl_write = FL_CF | FL_PF | FL_AF | FL_ZF | FL_SF;    // SAHF
+    t[0x9F].fl_read  = FL_CF | FL_PF | FL_AF | FL_ZF | FL_SF;    // LAHF
+    t[0xF5].fl_read  = t[0xF5].fl_write = FL_CF;                 // CMC
+    t[0xF8].fl_read  = 0; t[0xF8].fl_write = FL_CF;              // CLC
+    t[0xF9].fl_read  = 0; t[0xF9].fl_write = FL_CF;              // STC
+
+    for (int i : { 0x9A, 0xC2, 0xC3, 0xCA, 0xCB, 0xCC, 0xCD, 0xCE, 0xCF, 0xE0, 0xE1, 0xE2, 0xE3,
+                   0xE8, 0xE9, 0xEA, 0xEB, 0xF4, 0xFF }) {
+        t[i].ends_block = true;
+    }
+    for (int i = 0x70; i < 0x80; i++) {
+        t[i].ends_block = true;
+    }
+
+    return t;
+}
+
+static constexpr std::array<OpAttr, 0x100> make_opcode_attr_0F() {
+    std::array<OpAttr, 0x100> t{};
+    t.fill(A(true, IMM_NONE, OS_V, M_ALL));
+
+    for (int i : { 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0E, 0x0F, 0x77, 0xA0, 0xA1, 0xA2, 0xA8, 0xA9, 0xAA }) {
+        t[i] = A(false, IMM_NONE, OS_NONE, M_ALL);
+    }
+    for (int i = 0x30; i < 0x40; i++) {
+        t[i] = A(false, IMM_NONE, OS_NONE, M_ALL);  // 38 and 3A escape to maps not decoded here
+    }
+    for (int i = 0x70; i < 0x74; i++) {
+        t[i] = A(true, IMM_B, OS_NONE, M_ALL);
+    }
+    for (int i = 0x80; i < 0x90; i++) {
+        t[i] = A(false, IMM_Z, OS_NONE, M_ALL);
+    }
+    for (int i = 0x90; i < 0xA0; i++) {
+        t[i] = A(true, IMM_NONE, OS_B, M_ALL);
+    }
+    for (int i : { 0xA4, 0xAC, 0xBA, 0xC2, 0xC4, 0xC5, 0xC6 }) {
+        t[i] = A(true, IMM_B, OS_V, M_ALL);
+    }
+    t[0xB0] = A(true, IMM_NONE, OS_B, M_ALL);
+    t[0xC0] = A(true, IMM_NONE, OS_B, M_ALL);
+    for (int i = 0xC8; i < 0xD0; i++) {
+        t[i] = A(false, IMM_NONE, OS_V, M_ALL);
+    }
+
+    for (int i = 0x80; i < 0x90; i++) {
+        t[i].fl_read    = condFlags(i & 0xF);
+        t[i].ends_block = true;
+    }
+    for (int i = 0x90; i < 0xA0; i++) {
+        t[i].fl_read = condFlags(i & 0xF);
+    }
+    for (int i : { 0x05, 0x07, 0x0B, 0x22, 0x30, 0x34, 0x35 }) {
+        t[i].ends_block = true;  // SYSCALL SYSRET UD2 MOV CRn WRMSR SYSENTER SYSEXIT, the last three may switch modes
+    }
+
+    return t;
+}
+
+#undef A
+
+const std::array<bool (CPU::*)(), 0x100> CPU::opcode_table[3] = {
+    make_opcode_table<MODE_REAL>(),
+    make_opcode_table<MODE_PROT>(),
+    make_opcode_table<MODE_LONG>(),
+};
+const std::array<bool (CPU::*)(), 0x100> CPU::opcode_table_0F[3] = {
+    make_opcode_table_0F<MODE_REAL>(),
+    make_opcode_table_0F<MODE_PROT>(),
+    make_opcode_table_0F<MODE_LONG>(),
+};
+const std::array<OpAttr, 0x100> CPU::opcode_attr = make_opcode_attr();
+const std::array<OpAttr, 0x100> CPU::opcode_attr_0F = make_opcode_attr_0F();
\ No newline at end of file